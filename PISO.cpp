@@ -7,9 +7,34 @@
 #include <sstream>
 #include <unordered_map>
 #include <filesystem>
+#include <future>
+#include <memory>
+#include <limits>
+#include <numeric>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <optional>
+#include <atomic>
+#include <cstdio>
+#include <type_traits>
 #include <omp.h>
 
 #include "tdma.h"
+#include "adi.h"
+#include "multigrid.h"
+#include "rom.h"
+#include "dmd.h"
+#include "dual.h"
+#include "adjoint.h"
+#include "uq.h"
+#include "statistics.h"
+#include "live.h"
+#include "coupling.h"
+#include "sources.h"
+#include "timeseries.h"
 
 #pragma region input
 
@@ -49,11 +74,40 @@ std::string chooseInputFile(const std::string& inputDir) {
 	return files[choice].string(); // Complete path to the selected file
 }
           
+// Passive scalar transported with the liquid velocity
+struct ScalarInput {
+
+    std::string name = "";
+    double diffusivity = 0.0;               // [m2/s]
+    double source = 0.0;                    // Volumetric production rate [1/s]
+    double initial = 0.0;
+
+    int    inlet_bc = 0;                    // 0 Dirichlet, 1 Neumann
+    double inlet_value = 0.0;
+
+    int    outlet_bc = 1;                   // 0 Dirichlet, 1 Neumann
+    double outlet_value = 0.0;
+
+    std::string file = "";
+};
+
 struct Input {
 
     int    N = 0;                           // Number of cells [-]
     double L = 0.0;                         // Length of the domain [m]
 
+    int    Nr = 1;                          // Number of radial cells, 1 for the 1D solver [-]
+    double R = 0.0;                         // Radius of the axisymmetric domain [m]
+    int    wall_bc = 0;                     // Axial velocity at the wall: 0 no-slip, 1 slip
+    int    adi_sweeps = 2;                  // ADI sweeps per momentum and energy solve [-]
+    int    adi_pressure_sweeps = 50;        // Maximum ADI sweeps per pressure-correction solve [-]
+    double adi_pressure_tol = 1e-3;         // Residual reduction of the pressure-correction solve [-]
+    std::string pressure_solver = "";       // Axisymmetric pressure correction: multigrid or adi
+    std::string mg_cycle = "";              // Multigrid cycle: V or W
+    int    mg_smoothing_sweeps = 1;         // ADI relaxation sweeps before and after each coarse-grid correction [-]
+    int    mg_pressure_cycles = 20;         // Maximum multigrid cycles per pressure-correction solve [-]
+    double mg_pressure_tol = 1e-3;          // Residual reduction of the multigrid solve [-]
+
     double dt_user = 0.0;                   // User-defined time step [s]
     double simulation_time = 0.0;           // Total simulation time [s]
 
@@ -62,6 +116,76 @@ struct Input {
     double piso_outer_tol = 0.0;            // PISO outer tolerance [-]
     double piso_inner_tol = 0.0;            // PISO inner tolerance [-]
     bool   rhie_chow_on_off_l = true;       // RhieChow on/off [-]
+    bool   task_graph = true;               // Concurrent execution of independent phases on/off [-]
+    bool   piso_speculative = false;        // Speculative inner iterations on/off [-]
+    int    piso_inner_check_every = 1;      // Inner iterations between continuity residual checks [-]
+    int    piso_outer_check_every = 1;      // Outer iterations between momentum/energy residual checks [-]
+    bool   piso_adaptive_check = false;     // Adaptive residual check interval on/off [-]
+    bool   piso_inner_tol_adaptive = false; // Inner tolerance tied to the outer residual on/off [-]
+    double piso_inner_tol_max = 1e-2;       // Loosest adaptive inner tolerance [-]
+    double piso_forcing_max = 0.5;          // Largest forcing term of the adaptive inner tolerance [-]
+    double momentum_freeze_tol = 0.0;       // Relative change of face mass flux and velocity keeping the momentum matrix, 0 for never [-]
+    int    piso_step_budget = 0;            // Linear solves per time step, scalar groups with a matrix of their own included, 0 for no budget [-]
+    double piso_step_time_budget = 0.0;     // Wall time per time step, converted to linear solves, 0 for no budget [s]
+
+    double steady_tol = 0.0;                // Relative change per time step ending the run, 0 to run to simulation_time [-]
+
+    bool   statistics = false;              // Running statistics of u, p and T on/off [-]
+    double statistics_start = 0.0;          // Start of the statistics window [s]
+    double statistics_end = 0.0;            // End of the statistics window, simulation_time by default [s]
+    std::string statistics_file = "";       // Per-cell mean, RMS, minimum and maximum over the window
+
+    std::string live_fields = "";           // Shared-memory segment the latest fields are published to, empty for none
+    int    live_fields_every = 1;           // Time steps between publishes [-]
+    bool   live_fields_watch = false;       // Run as a reader of the segment instead of solving on/off [-]
+
+    std::string coupling_socket = "";       // Unix domain socket boundary values are exchanged over, empty for none
+    int    coupling_lag = 1;                // Time steps an inflow answer has to arrive before it is applied [-]
+    int    coupling_ping = 1000;            // Round trips timed before a coupled run [-]
+    bool   coupling_client = false;         // Run the stand-in client of the socket instead of solving on/off [-]
+
+    std::string daemon_spool = "";          // Spool directory of a daemon run, empty for a plain run
+    int    daemon_workers = 1;              // Jobs run concurrently [-]
+    double daemon_poll = 0.1;               // Interval between looks at the spool [s]
+    double daemon_idle_exit = 0.0;          // Idle time ending the daemon, 0 to run until stopped [s]
+
+    double wall_time_budget = 0.0;          // Wall time a run must finish within, choosing dt, tolerances and outputs, 0 for fixed steps [s]
+    double wall_time_dt_min = 0.0;          // Smallest time step of a budgeted run, dt_user / 10 by default [s]
+    double wall_time_dt_max = 0.0;          // Largest time step of a budgeted run, 10 dt_user by default [s]
+    double wall_time_tol_max = 0.0;         // Loosest outer tolerance of a budgeted run, piso_outer_tol by default [-]
+    int    wall_time_output_min = 0;        // Fewest outputs of a budgeted run, number_output by default [-]
+    double wall_time_margin = 0.05;         // Fraction of the wall time budget held back [-]
+
+    int    dmd_every = 0;                   // Time steps between DMD extrapolations, 0 for none [-]
+    int    dmd_window = 12;                 // Snapshots per DMD fit [-]
+    double dmd_rank_tol = 1e-4;             // Increment singular values kept by DMD, relative to the largest [-]
+
+    bool   rom = false;                     // Reduced-order surrogate mode on/off [-]
+    std::vector<std::string> rom_parameters;    // Inputs varied between surrogate evaluations
+    std::string rom_training_file = "";     // Parameter values of the full training runs, one set per line
+    std::string rom_query_file = "";        // Parameter values to evaluate, one set per line
+    std::string rom_results_file = "";      // Per-query estimator, model used and timing
+    double rom_pod_tol = 1e-16;             // Fraction of the snapshot energy the POD bases may discard [-]
+    double rom_tol = 1e-6;                  // Largest surrogate residual accepted without a full run [-]
+    double rom_steady_tol = 1e-9;           // Relative change per time step ending a full run [-]
+    bool   rom_enrich = true;               // Full fallback runs extend the snapshot set on/off [-]
+
+    std::vector<std::string> sensitivity_parameters;    // Inputs differentiated by a tangent-linear run, none for a plain run
+
+    std::string adjoint_objective = "";     // Objective of an adjoint gradient run (T_outlet, pressure_drop), empty for a plain run
+    int    adjoint_checkpoints = 32;        // States stored by the adjoint run besides the initial one [-]
+    std::string adjoint_gradient_file = ""; // Gradients of the objective
+
+    std::vector<std::string> uq_parameters;         // Uncertain inputs of a UQ run, none for a plain run
+    std::vector<uq::Distribution> uq_distributions; // Their distributions, from <name>_distribution
+    int    uq_level = 3;                    // Smolyak sparse-grid level [-]
+    std::vector<std::string> uq_outputs;    // Outputs whose statistics are computed
+    std::string uq_results_file = "";       // Mean, variance and Sobol indices of every output
+
+    bool   fixed_size = false;              // Compile-time sized solver with step latency report on/off [-]
+
+    int    cosim_instances = 0;             // Instances interleaved on one thread by a co-simulation run, 0 for a plain run [-]
+    bool   cosim_yield_outer = false;       // Co-simulation instances yield after every outer iteration on/off [-]
 
     double rho = 0.0;                       // Density [kg/m3]
     double mu = 0.0;                        // Dynamic viscosity [kg/(m s)]
@@ -76,6 +200,9 @@ struct Input {
     double z_cond_start = 0.0;              // Condensation zone start [m]
     double z_cond_end = 0.0;                // Condensation zone end [m]
 
+    std::string evap_profile = "";          // Evaporation zone source profile file, empty if uniform
+    std::string cond_profile = "";          // Condensation zone source profile file, empty if uniform
+
     int    u_inlet_bc = 0;                  // 0 Dirichlet, 1 Neumann
     double u_inlet_value = 0.0;             // [m/s]
 
@@ -98,55 +225,103 @@ struct Input {
     double p_initial = 0.0;                 // [Pa]
     double T_initial = 0.0;                 // [K]
 
+    // Optional time tables ("t value" files) replacing the constants above
+    std::string u_inlet_table = "";
+    std::string u_outlet_table = "";
+    std::string T_inlet_table = "";
+    std::string T_outlet_table = "";
+    std::string p_inlet_table = "";
+    std::string p_outlet_table = "";
+    std::string S_m_table = "";             // Scales S_m_cell in both zones, with their signs
+    std::string S_h_table = "";             // Scales S_h_cell in both zones, with their signs
+
     int number_output = 0;            // Number of outputs [-]
 
     std::string velocity_file = "";
     std::string pressure_file = "";
     std::string temperature_file = "";
+    std::string radial_velocity_file = "";  // Axisymmetric runs only
+
+    std::vector<ScalarInput> scalars;       // Passive scalars, none by default
 };
 
-Input readInput(const std::string& filename) {
+// Keys of `base`, if given, apply wherever the file itself does not set them
+Input readInput(const std::string& filename, const std::string& base = "") {
 
-    std::ifstream file(filename);
     std::string line, key, eq, value;
 
     std::unordered_map<std::string, std::string> dict;
+    std::unordered_map<std::string, std::string> source;    // File each key was read from
 
-    while (std::getline(file, line)) {
+    for (const std::string& name : { base, filename }) {
 
-        // Removes comments
-        auto comment = line.find('#');
-        if (comment != std::string::npos)
-            line = line.substr(0, comment);
+        if (name.empty()) continue;
 
-		// Removes empty lines
-        if (line.find_first_not_of(" \t") == std::string::npos)
-            continue;
+        std::ifstream file(name);
 
-        // Finds '='
-        auto pos = line.find('=');
-        if (pos == std::string::npos)
-            continue;
+        while (std::getline(file, line)) {
+
+            // Removes comments
+            auto comment = line.find('#');
+            if (comment != std::string::npos)
+                line = line.substr(0, comment);
+
+			// Removes empty lines
+            if (line.find_first_not_of(" \t") == std::string::npos)
+                continue;
+
+            // Finds '='
+            auto pos = line.find('=');
+            if (pos == std::string::npos)
+                continue;
 
-        std::string key = line.substr(0, pos);
-        std::string value = line.substr(pos + 1);
+            std::string key = line.substr(0, pos);
+            std::string value = line.substr(pos + 1);
 
-        // Trim key
-        key.erase(0, key.find_first_not_of(" \t"));
-        key.erase(key.find_last_not_of(" \t") + 1);
+            // Trim key
+            key.erase(0, key.find_first_not_of(" \t"));
+            key.erase(key.find_last_not_of(" \t") + 1);
 
-        // Trim value
-        value.erase(0, value.find_first_not_of(" \t"));
-        value.erase(value.find_last_not_of(" \t") + 1);
+            // Trim value
+            value.erase(0, value.find_first_not_of(" \t"));
+            value.erase(value.find_last_not_of(" \t") + 1);
 
-        dict[key] = value;
+            dict[key] = value;
+            source[key] = name;
+        }
     }
 
+    // Optional keys fall back to the given default when absent from the file
+    auto optional = [&dict](const std::string& key, const std::string& fallback) {
+        auto it = dict.find(key);
+        return it != dict.end() ? it->second : fallback;
+    };
+
     Input in;
 
     in.N = std::stoi(dict["N"]);
     in.L = std::stod(dict["L"]);
 
+    in.Nr = std::stoi(optional("Nr", "1"));
+    in.R = std::stod(optional("R", "0"));
+    in.wall_bc = std::stoi(optional("wall_bc", "0"));
+    in.adi_sweeps = std::stoi(optional("adi_sweeps", "2"));
+    in.adi_pressure_sweeps = std::stoi(optional("adi_pressure_sweeps", "50"));
+    in.adi_pressure_tol = std::stod(optional("adi_pressure_tol", "1e-3"));
+    in.pressure_solver = optional("pressure_solver", "multigrid");
+    in.mg_cycle = optional("mg_cycle", "V");
+    in.mg_smoothing_sweeps = std::stoi(optional("mg_smoothing_sweeps", "1"));
+    in.mg_pressure_cycles = std::stoi(optional("mg_pressure_cycles", "20"));
+    in.mg_pressure_tol = std::stod(optional("mg_pressure_tol", "1e-3"));
+
+    if (in.pressure_solver != "multigrid" && in.pressure_solver != "adi")
+        throw std::runtime_error("Input: pressure_solver must be multigrid or adi");
+    if (in.mg_cycle != "V" && in.mg_cycle != "W")
+        throw std::runtime_error("Input: mg_cycle must be V or W");
+
+    if (in.Nr > 1 && in.R <= 0.0)
+        throw std::runtime_error("Input: R must be positive when Nr > 1");
+
     in.dt_user = std::stod(dict["dt_user"]);
     in.simulation_time = std::stod(dict["simulation_time"]);
 
@@ -155,6 +330,106 @@ Input readInput(const std::string& filename) {
     in.piso_outer_tol = std::stod(dict["piso_outer_tol"]);
     in.piso_inner_tol = std::stod(dict["piso_inner_tol"]);
     in.rhie_chow_on_off_l = std::stoi(dict["rhie_chow"]);
+    in.task_graph = std::stoi(optional("task_graph", "1"));
+    in.piso_speculative = std::stoi(optional("piso_speculative", "0"));
+    in.piso_inner_check_every = std::stoi(optional("piso_inner_check_every", "1"));
+    in.piso_outer_check_every = std::stoi(optional("piso_outer_check_every", "1"));
+    in.piso_adaptive_check = std::stoi(optional("piso_adaptive_check", "0"));
+    in.piso_inner_tol_adaptive = std::stoi(optional("piso_inner_tol_adaptive", "0"));
+    in.piso_inner_tol_max = std::stod(optional("piso_inner_tol_max", "1e-2"));
+    in.piso_forcing_max = std::stod(optional("piso_forcing_max", "0.5"));
+    in.momentum_freeze_tol = std::stod(optional("momentum_freeze_tol", "0"));
+    in.piso_step_budget = std::stoi(optional("piso_step_budget", "0"));
+    in.piso_step_time_budget = std::stod(optional("piso_step_time_budget", "0"));
+
+    in.steady_tol = std::stod(optional("steady_tol", "0"));
+
+    in.statistics = std::stoi(optional("statistics", "0"));
+    in.statistics_start = std::stod(optional("statistics_start", "0"));
+    in.statistics_end = dict.count("statistics_end") ? std::stod(dict["statistics_end"]) : in.simulation_time;
+    in.statistics_file = optional("statistics_file", "statistics.dat");
+
+    in.live_fields = optional("live_fields", "");
+    in.live_fields_every = std::max(std::stoi(optional("live_fields_every", "1")), 1);
+    in.live_fields_watch = std::stoi(optional("live_fields_watch", "0"));
+
+    in.coupling_socket = optional("coupling_socket", "");
+    in.coupling_lag = std::max(std::stoi(optional("coupling_lag", "1")), 0);
+    in.coupling_ping = std::stoi(optional("coupling_ping", "1000"));
+    in.coupling_client = std::stoi(optional("coupling_client", "0"));
+
+    in.daemon_spool = optional("daemon_spool", "");
+    in.daemon_workers = std::stoi(optional("daemon_workers", "1"));
+    in.daemon_poll = std::stod(optional("daemon_poll", "0.1"));
+    in.daemon_idle_exit = std::stod(optional("daemon_idle_exit", "0"));
+
+    in.wall_time_budget = std::stod(optional("wall_time_budget", "0"));
+    in.wall_time_dt_min = dict.count("wall_time_dt_min") ? std::stod(dict["wall_time_dt_min"]) : 0.1 * in.dt_user;
+    in.wall_time_dt_max = dict.count("wall_time_dt_max") ? std::stod(dict["wall_time_dt_max"]) : 10.0 * in.dt_user;
+    in.wall_time_tol_max = std::max(std::stod(optional("wall_time_tol_max", "0")), in.piso_outer_tol);
+    in.wall_time_margin = std::stod(optional("wall_time_margin", "0.05"));
+
+    if (in.wall_time_budget > 0.0 && !(in.wall_time_dt_min > 0.0 && in.wall_time_dt_min <= in.wall_time_dt_max))
+        throw std::runtime_error("Input: wall_time_dt_min must be positive and at most wall_time_dt_max");
+
+    in.dmd_every = std::stoi(optional("dmd_every", "0"));
+    in.dmd_window = std::stoi(optional("dmd_window", "12"));
+    in.dmd_rank_tol = std::stod(optional("dmd_rank_tol", "1e-4"));
+
+    if (in.dmd_every > 0 && in.dmd_window < 3)
+        throw std::runtime_error("Input: dmd_window must be at least 3");
+
+    in.rom = std::stoi(optional("rom", "0"));
+    in.rom_pod_tol = std::stod(optional("rom_pod_tol", "1e-16"));
+    in.rom_tol = std::stod(optional("rom_tol", "1e-6"));
+    in.rom_steady_tol = std::stod(optional("rom_steady_tol", "1e-9"));
+    in.rom_enrich = std::stoi(optional("rom_enrich", "1"));
+
+    auto comma_list = [&](const std::string& key) {
+        std::stringstream items(optional(key, ""));
+        std::vector<std::string> list;
+        std::string item;
+        while (std::getline(items, item, ',')) {
+            item.erase(0, item.find_first_not_of(" \t"));
+            item.erase(item.find_last_not_of(" \t") + 1);
+            if (!item.empty()) list.push_back(item);
+        }
+        return list;
+    };
+
+    in.rom_parameters = comma_list("rom_parameters");
+
+    if (in.rom && in.rom_parameters.empty())
+        throw std::runtime_error("Input: rom needs rom_parameters");
+
+    in.sensitivity_parameters = comma_list("sensitivity_parameters");
+
+    in.adjoint_objective = optional("adjoint_objective", "");
+    in.adjoint_checkpoints = std::stoi(optional("adjoint_checkpoints", "32"));
+    in.adjoint_gradient_file = optional("adjoint_gradient_file", "adjoint_gradient.dat");
+
+    if (!in.adjoint_objective.empty() && in.adjoint_objective != "T_outlet" && in.adjoint_objective != "pressure_drop")
+        throw std::runtime_error("Input: adjoint_objective must be T_outlet or pressure_drop");
+    if (in.adjoint_checkpoints < 0)
+        throw std::runtime_error("Input: adjoint_checkpoints must not be negative");
+
+    // Uncertain inputs: "uq_parameters = mu, k" plus "mu_distribution = uniform 8e-4 1.2e-3"
+    in.uq_parameters = comma_list("uq_parameters");
+    for (const std::string& name : in.uq_parameters) {
+        if (!dict.count(name + "_distribution"))
+            throw std::runtime_error("Input: uncertain parameter " + name + " needs " + name + "_distribution");
+        in.uq_distributions.push_back(uq::Distribution::parse(dict[name + "_distribution"]));
+    }
+
+    in.uq_level = std::stoi(optional("uq_level", "3"));
+    in.uq_outputs = comma_list("uq_outputs");
+    if (in.uq_outputs.empty()) in.uq_outputs = { "T_outlet", "pressure_drop" };
+    in.uq_results_file = optional("uq_results_file", "uq_results.dat");
+
+    in.fixed_size = std::stoi(optional("fixed_size", "0"));
+
+    in.cosim_instances = std::stoi(optional("cosim_instances", "0"));
+    in.cosim_yield_outer = std::stoi(optional("cosim_yield_outer", "0"));
 
     in.rho = std::stod(dict["rho"]);
     in.mu = std::stod(dict["mu"]);
@@ -169,6 +444,16 @@ Input readInput(const std::string& filename) {
     in.z_cond_start = std::stod(dict["z_cond_start"]);
     in.z_cond_end = std::stod(dict["z_cond_end"]);
 
+    // Auxiliary files are looked up next to the input file that names them
+    auto input_relative = [&dict, &source](const std::string& key) {
+        auto it = dict.find(key);
+        if (it == dict.end() || it->second.empty()) return std::string();
+        return (fs::path(source[key]).parent_path() / it->second).string();
+    };
+
+    in.evap_profile = input_relative("evap_profile");
+    in.cond_profile = input_relative("cond_profile");
+
     in.u_inlet_bc = std::stoi(dict["u_inlet_bc"]);
     in.u_inlet_value = std::stod(dict["u_inlet_value"]);
 
@@ -191,628 +476,5252 @@ Input readInput(const std::string& filename) {
 	in.T_initial = std::stod(dict["T_initial"]);
     in.p_initial = std::stod(dict["p_initial"]);
 
+    in.u_inlet_table = input_relative("u_inlet_table");
+    in.u_outlet_table = input_relative("u_outlet_table");
+    in.T_inlet_table = input_relative("T_inlet_table");
+    in.T_outlet_table = input_relative("T_outlet_table");
+    in.p_inlet_table = input_relative("p_inlet_table");
+    in.p_outlet_table = input_relative("p_outlet_table");
+    in.S_m_table = input_relative("S_m_table");
+    in.S_h_table = input_relative("S_h_table");
+
+    in.rom_training_file = input_relative("rom_training_file");
+    in.rom_query_file = input_relative("rom_query_file");
+    in.rom_results_file = optional("rom_results_file", "rom_results.dat");
+
     in.number_output = std::stoi(dict["number_output"]);
+    in.wall_time_output_min = std::stoi(optional("wall_time_output_min", std::to_string(in.number_output)));
     in.velocity_file = dict["velocity_file"];
     in.pressure_file = dict["pressure_file"];
     in.temperature_file = dict["temperature_file"];
+    in.radial_velocity_file = optional("radial_velocity_file", "radial_velocity.dat");
+
+    // Passive scalars: "scalars = age, dye" plus optional <name>_<property> keys.
+    // The diffusivity defaults to the thermal one, so such scalars share the
+    // energy matrix when their BC types match the temperature ones.
+    std::stringstream names(optional("scalars", ""));
+    std::string name;
+
+    while (std::getline(names, name, ',')) {
+
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        if (name.empty()) continue;
+
+        ScalarInput sc;
+        sc.name = name;
+        sc.diffusivity = dict.count(name + "_diffusivity") ? std::stod(dict[name + "_diffusivity"]) : in.k / (in.rho * in.cp);
+        sc.source = std::stod(optional(name + "_source", "0"));
+        sc.initial = std::stod(optional(name + "_initial", "0"));
+        sc.inlet_bc = std::stoi(optional(name + "_inlet_bc", "0"));
+        sc.inlet_value = std::stod(optional(name + "_inlet_value", "0"));
+        sc.outlet_bc = std::stoi(optional(name + "_outlet_bc", "1"));
+        sc.outlet_value = std::stod(optional(name + "_outlet_value", "0"));
+        sc.file = optional(name + "_file", name + ".dat");
+
+        in.scalars.push_back(sc);
+    }
 
     return in;
 }
 
 #pragma endregion
 
+#pragma region solver
+
 // =======================================================================
-//                                MAIN
+//                               SOLVER
 // =======================================================================
 
-int main() {
+// Decides after which iterations a convergence check is evaluated. With a fixed
+// interval K the residual is computed every K iterations, so at most K - 1
+// iterations are spent past convergence. The adaptive policy estimates the
+// contraction rate from the last two checks and schedules the next check no
+// later than the iteration at which the tolerance is predicted to be reached:
+// checks are sparse while the residual is far from the tolerance or stagnates,
+// and happen every iteration close to it.
+struct ResidualSchedule {
+
+    int    every = 1;                       // (Maximum) iterations between two checks [-]
+    bool   adaptive = false;                // Adaptive interval on/off [-]
+
+    int    next = 1;                        // Iteration at which the next check is due [-]
+    int    first_iter = 0;                  // Iteration of the first check since the reset [-]
+    double first_residual = 0.0;            // Residual at the first check since the reset [-]
+    int    last_iter = 0;                   // Iteration of the last check [-]
+    double last_residual = 0.0;             // Residual at the last check [-]
+
+    void reset() {
+        next = adaptive ? 1 : every;
+        first_iter = 0;
+        first_residual = 0.0;
+        last_iter = 0;
+        last_residual = 0.0;
+    }
 
-    std::string inputFile = chooseInputFile("input");
-    std::cout << "Using input file: " << inputFile << std::endl;
+    bool due(int iter) const { return iter >= next; }
 
-    Input in = readInput(inputFile);
+    void update(int iter, double residual, double tol) {
+
+        int interval = adaptive ? 1 : every;
+
+        if (adaptive && last_iter > 0 && residual > tol) {
 
-	const int    N = in.N;                                              // Number of cells [-]
-    const double L = in.L;                                              // Length of the domain [m]
-	const double dz = L / N;                                            // Cell size [m]
+            if (residual < last_residual) {
 
-	double dt_user = in.dt_user;                                        // User-defined time step [s]
-	const double simulation_time = in.simulation_time;                  // Total simulation time [s]
-	const int time_steps = static_cast<int>(simulation_time / dt_user); // Number of time steps [-]
-        
-	const int number_output = in.number_output;                         // Number of outputs [-]
-	const int print_every = time_steps / number_output;                 // Print output every n time steps [-]
+                const double rate = std::pow(residual / last_residual, 1.0 / (iter - last_iter));
+                const double remaining = std::log(tol / residual) / std::log(rate);
 
-	double time_total = 0.0;                                            // Total simulation time [s]
-    double dt = dt_user;                                                // Time step [s]
+                interval = static_cast<int>(std::clamp(std::floor(remaining), 1.0, static_cast<double>(every)));
+            }
+            else interval = every;                  // Not contracting: convergence is not imminent
+        }
 
-	const int tot_outer_l = in.piso_outer_iter;                         // PISO outer iterations [-]
-	const int tot_inner_l = in.piso_inner_iter;                         // PISO inner iterations [-]
-	const double outer_tol_l = in.piso_outer_tol;                       // PISO outer tolerance [-]
-	const double inner_tol_l = in.piso_inner_tol;                       // PISO inner tolerance [-]
-	const bool rhie_chow_on_off_l = in.rhie_chow_on_off_l;              // RhieChow interpolation on/off (1/0) [-]
+        if (last_iter == 0) {
+            first_iter = iter;
+            first_residual = residual;
+        }
 
-	const double rho_l = in.rho;                                        // Density [kg/m3]
-	const double mu = in.mu;                                            // Dynamic viscosity [kg/(m s)]
-	const double k = in.k;                                              // Thermal diffusivity [m2/s]
-    const double cp = in.cp;                                            // Specific heat capacity at constant pressure [J/kgK]
+        last_iter = iter;
+        last_residual = residual;
+        next = iter + interval;
+    }
+};
 
-	std::vector<double> u_l(N, in.u_initial);                           // Velocity field [m/s]
-	std::vector<double> T_l(N, in.T_initial);                           // Temperature field [K]
-	std::vector<double> p_l(N, in.p_initial);                           // Pressure field [Pa]
+// Tabulated signals driving boundary values or zone strengths
+struct Signals {
 
-	std::vector<double> u_l_old = u_l;                                  // Previous time step velocity [m/s]
-	std::vector<double> T_l_old = T_l;                                  // Previous time step temperature [K]
-	std::vector<double> p_l_old = p_l;                                  // Previous time step pressure [Pa]
+    struct Driver {
+        std::unique_ptr<timeseries::Series> series;
+        std::vector<std::pair<double*, double>> targets;    // Value written and its factor
+    };
 
-	std::vector<double> T_l_iter(N, 0.0);                               // Temperature field for Picard iteration [K]
+    std::vector<Driver> drivers;
 
-	std::vector<double> p_prime_l(N, 0.0);                              // Pressure correction [Pa]
-	std::vector<double> p_storage_l(N + 2);                             // Padded pressure storage for RhieChow [Pa]
-	double* p_padded_l = &p_storage_l[1];                               // Pointer to the real nodes of the padded pressure storage [Pa]
+    void drive(const std::string& table, std::vector<std::pair<double*, double>> targets) {
 
-	// p_storage_l initialization
-    for (int i = 0; i < N; ++i)
-        p_storage_l[i + 1] = p_l[i];
+        if (table.empty()) return;
 
-    p_storage_l[0] = p_l[0];
-    p_storage_l[N + 1] = p_l[N - 1];
+        Driver driver;
+        driver.series = std::make_unique<timeseries::Series>(table);
+        driver.targets = std::move(targets);
+
+        drivers.push_back(std::move(driver));
+    }
 
-	std::vector<double> u_prev(N, 0.0);                                 // Previous iteration velocity for convergence check [m/s]
-	std::vector<double> p_prev(N, 0.0);                                 // Previous iteration pressure for convergence check [Pa]
-	std::vector<double> T_prev(N, 0.0);                                 // Previous iteration temperature for convergence check [K]
+    // Evaluates the signals at time t
+    void apply(double t) {
 
-	std::vector<double> S_m(N, 0.0);                                    // Volumetric mass source [kg/(m3 s)]
-	std::vector<double> S_h(N, 0.0);                                    // Volumetric heat source [W/m3]
+        for (Driver& driver : drivers) {
 
-	// Source vectors definition
-    for (int i = 0; i < N; ++i) {
+            const double value = driver.series->at(t);
+
+            for (auto& target : driver.targets)
+                *target.first = target.second * value;
+        }
+    }
+};
 
-        const double z = (i + 0.5) * dz;
+// Evaporation and condensation zones of an N-cell axial grid, the evaporator
+// taking precedence where the zones overlap. The source tables, if any, are
+// registered with `signals`: evaporator zones take the signal as is, condenser
+// zones with opposite sign. `zones` must not be resized afterwards. The zone
+// strengths are S_m_cell and S_h_cell, passed apart from `in` so they can
+// carry derivatives.
+template <typename Real>
+void define_source_zones(const Input& in, int N, double dz, const Real& S_m_cell, const Real& S_h_cell,
+    std::vector<sources::BasicZone<Real>>& zones, Signals& signals) {
+
+    std::vector<sources::Zone> evap = sources::cells_in(in.z_evap_start, in.z_evap_end, N, dz, {});
+    std::vector<sources::Zone> cond = sources::cells_in(in.z_cond_start, in.z_cond_end, N, dz, evap);
+
+    for (const sources::Zone& cells : evap) {
+        sources::BasicZone<Real> zone;
+        zone.begin = cells.begin;
+        zone.end = cells.end;
+        zone.S_m = S_m_cell;
+        zone.S_h = S_h_cell;
+        if (!in.evap_profile.empty()) zone.profile = sources::profile(in.evap_profile, zone.end - zone.begin);
+        zones.push_back(zone);
+    }
+
+    for (const sources::Zone& cells : cond) {
+        sources::BasicZone<Real> zone;
+        zone.begin = cells.begin;
+        zone.end = cells.end;
+        zone.S_m = -S_m_cell;
+        zone.S_h = -S_h_cell;
+        if (!in.cond_profile.empty()) zone.profile = sources::profile(in.cond_profile, zone.end - zone.begin);
+        zones.push_back(zone);
+    }
+
+    // Tables drive the values only; derivatives seeded into the strengths are kept
+    std::vector<std::pair<double*, double>> S_m_targets, S_h_targets;
+    for (std::size_t z = 0; z < zones.size(); ++z) {
+        const double sign = z < evap.size() ? 1.0 : -1.0;
+        S_m_targets.push_back({ &dual::value_ref(zones[z].S_m), sign });
+        S_h_targets.push_back({ &dual::value_ref(zones[z].S_h), sign });
+    }
+
+    signals.drive(in.S_m_table, S_m_targets);
+    signals.drive(in.S_h_table, S_h_targets);
+}
+
+// Boundary values of the solver s, driven by the time tables of the input
+template <typename S>
+void drive_boundary_values(const Input& in, S& s, Signals& signals) {
+
+    signals.drive(in.u_inlet_table, { { &dual::value_ref(s.u_inlet_value), 1.0 } });
+    signals.drive(in.u_outlet_table, { { &dual::value_ref(s.u_outlet_value), 1.0 } });
+    signals.drive(in.T_inlet_table, { { &dual::value_ref(s.T_inlet_value), 1.0 } });
+    signals.drive(in.T_outlet_table, { { &dual::value_ref(s.T_outlet_value), 1.0 } });
+    signals.drive(in.p_inlet_table, { { &dual::value_ref(s.p_inlet_value), 1.0 } });
+    signals.drive(in.p_outlet_table, { { &dual::value_ref(s.p_outlet_value), 1.0 } });
+}
+
+// =======================================================================
+//                        DISCRETIZATION KERNELS
+// =======================================================================
+
+// The discretization of the 1D solvers, shared by BasicSolver and the
+// fixed-size PisoFixed. A solver `s` exposes its state under common names:
+// N, dz, dt, rho_l, mu, k, cp, K, CF, rhie_chow_on_off_l, the boundary types
+// and values, the fields u_l, u_l_old, T_l_old, p_l, p_prime_l, p_storage_l
+// and p_padded_l (indexable from -1 to N), the coefficients aLU to dLU, aLT
+// to dLT, LP.diag, LP.off and dLP, the face velocities u_face_l, and
+// for_interior_cells(row), which calls row(i, S_m, S_h) for the interior
+// cells.
+namespace discretization {
+
+    // -- Pointwise terms, shared with the axisymmetric Solver2D. Each solver
+    // passes them its own measures: the 1D solvers work per unit area, with
+    // unit face areas and the cell length as volume; Solver2D per radian,
+    // with the face areas and the volumes of its (z, r) cells.
+
+    // Inverse momentum diagonal of a face, averaged from the diagonals per
+    // unit face area of its two cells [m2s/kg]
+    template <typename T>
+    T face_inverse_diagonal(const T& b_l, const T& b_r) {
+        return 0.5 * (1.0 / b_l + 1.0 / b_r);
+    }
+
+    // Face velocity between cells l and r: linear interpolation plus, if
+    // rhie_chow, the RhieChow correction from the four pressures around the
+    // face and its inverse diagonal d [m/s]
+    template <typename T>
+    T face_velocity(const T& u_l, const T& u_r, const T& d,
+        const T& p_ll, const T& p_l, const T& p_r, const T& p_rr, bool rhie_chow) {
+
+        const T rc = -d / 4.0 * (p_ll - 3.0 * p_l + 3.0 * p_r - p_rr);     // [m/s]
+        return 0.5 * (u_l + u_r) + rhie_chow * rc;
+    }
+
+    // Upwind convection and central diffusion along one direction of a cell,
+    // from the fluxes F and the diffusion conductances D of its lower and
+    // upper faces: the two neighbour coefficients, in the sign of the
+    // tridiagonal rows, and the outflow part of the diagonal
+    template <typename Real>
+    struct Upwind {
+        Real a, c, outflow;
+    };
+
+    template <typename Real>
+    Upwind<Real> upwind(const Real& F_l, const Real& F_r, const Real& D_l, const Real& D_r) {
+        return {
+            - std::max<Real>(F_l, 0.0) - D_l,
+            - std::max<Real>(-F_r, 0.0) - D_r,
+            + std::max<Real>(F_r, 0.0) + std::max<Real>(-F_l, 0.0)
+        };
+    }
+
+    // DarcyForchheimer drag of a cell of volume V at the speed U [kg/(m2s)]
+    template <typename S, typename Speed, typename Volume>
+    auto drag(const S& s, const Speed& U, const Volume& V) {
+        return +s.mu / s.K * V + s.rho_l * s.CF * U / std::sqrt(s.K) * V;
+    }
+
+    // Momentum right-hand side of a cell: the pressures of its two
+    // neighbours along the direction on the face area A, and the old time
+    // level of its volume V [kg/(ms2)]
+    template <typename S, typename P, typename U, typename Area, typename Volume>
+    auto momentum_source(const S& s, const P& p_l, const P& p_r, const U& u_old, const Area& A, const Volume& V) {
+        return - 0.5 * (p_r - p_l) * A + s.rho_l * u_old * V / s.dt;
+    }
+
+    // Energy right-hand side of a cell of volume V: the old time level, the
+    // heat source S_h and the old value carried in by the mass source S_m.
+    // The passive scalars use it with their own source. [W/m2]
+    template <typename S, typename T, typename Sm, typename Sh, typename Volume>
+    auto energy_source(const S& s, const T& T_old, const Sm& S_m, const Sh& S_h, const Volume& V) {
+        return + V / s.dt * T_old + S_h * V + S_m * T_old * V / s.rho_l;
+    }
+
+    // Diagonal of an inlet or outlet momentum row: the unsteady term of the
+    // cell of volume V, the diffusion D over the half cell to the boundary
+    // face, and the flux F out through the interior face [kg/(m2s)]
+    template <typename S, typename D, typename F, typename Volume>
+    auto momentum_boundary_diagonal(const S& s, const D& diffusion, const F& outflow, const Volume& V) {
+        return s.rho_l * V / s.dt + 2 * diffusion + outflow;
+    }
+
+    // Boundary row with the diagonal diag, fixing the value (Dirichlet,
+    // bc = 0) or a zero gradient (Neumann, bc = 1): the diagonal, the
+    // neighbour coefficient in the sign of the tridiagonal rows, and the
+    // right-hand side
+    template <typename Real>
+    struct BoundaryRow {
+        Real diag, neighbour, rhs;
+    };
+
+    template <typename Real, typename Value>
+    BoundaryRow<Real> boundary_row(int bc, const Real& diag, const Value& value) {
+        if (bc == 0) return { diag, 0.0, diag * value };       // Dirichlet BC
+        return { diag, -diag, 0.0 };                            // Neumann BC
+    }
+
+    // Velocity correction of a cell from the pressure corrections of its two
+    // neighbours along the direction and its momentum diagonal per unit face
+    // area b [m/s]
+    template <typename P, typename B>
+    auto velocity_correction(const P& p_prime_l, const P& p_prime_r, const B& b) {
+        return (p_prime_r - p_prime_l) / (2.0 * b);
+    }
 
-        if (z >= in.z_evap_start && z <= in.z_evap_end) {
-            S_m[i] = in.S_m_cell;
-            S_h[i] = in.S_h_cell;
+    // Reference force of the momentum residuals, the largest of the
+    // inertial, unsteady and viscous forces at the speed U_ref [kg/(ms2)]
+    template <typename S>
+    double momentum_scale(const S& s, double U_ref) {
+
+        auto v = [](const auto& x) { return dual::value(x); };
+
+        const double F_inertia = v(s.rho_l) * U_ref * U_ref;
+        const double F_unsteady = v(s.rho_l) * U_ref * s.dz / s.dt;
+        const double F_viscous = v(s.mu) * U_ref / s.dz;
+        return std::max({ F_inertia, F_unsteady, F_viscous, 1e-30 });
+    }
+
+    // Continuity residual: the largest cell mass imbalance, relative to the
+    // largest linearly interpolated face mass flux or mass source. The
+    // reference and the largest imbalance are gathered in the same pass:
+    // dividing the maximum by the reference afterwards gives the same value
+    // as taking the maximum of the normalized imbalances.
+    struct ContinuityResidual {
+
+        double flux_ref = 0.0;
+        double source_ref = 0.0;
+        double imbalance = 0.0;
+
+        void face(double flux) {
+            flux_ref = std::max(flux_ref, std::abs(flux));
+        }
+
+        // Cell with the mass source S_m and the net outflow of its faces
+        void cell(double S_m, double outflow) {
+            source_ref = std::max(source_ref, std::abs(S_m));
+            imbalance = std::max(imbalance, std::abs(S_m - outflow));
         }
-        else if (z >= in.z_cond_start && z <= in.z_cond_end) {
-            S_m[i] = -in.S_m_cell;
-            S_h[i] = -in.S_h_cell;
+
+        void merge(const ContinuityResidual& o) {
+            flux_ref = std::max(flux_ref, o.flux_ref);
+            source_ref = std::max(source_ref, o.source_ref);
+            imbalance = std::max(imbalance, o.imbalance);
+        }
+
+        double value() const {
+            return imbalance / std::max({ flux_ref, source_ref, 1e-30 });
         }
+    };
+
+    // Face velocities of interior cell i, linear interpolation plus the
+    // RhieChow correction, and the averaged inverse momentum diagonals of
+    // the two faces, computed in T from the stored scalars mapped by v
+    template <typename T>
+    struct CellFaces {
+        T invb_l, invb_r;                   // [m2s/kg]
+        T u_l, u_r;                         // [m/s]
+    };
+
+    template <typename T, typename S, typename Value>
+    CellFaces<T> cell_faces(const S& s, int i, Value v) {
+
+        CellFaces<T> f;
+
+        const auto& p = s.p_padded_l;
+
+        f.invb_l = face_inverse_diagonal<T>(v(s.bLU[i - 1]), v(s.bLU[i]));
+        f.invb_r = face_inverse_diagonal<T>(v(s.bLU[i + 1]), v(s.bLU[i]));
+
+        f.u_l = face_velocity<T>(v(s.u_l[i - 1]), v(s.u_l[i]), f.invb_l,
+            v(p[i - 2]), v(p[i - 1]), v(p[i]), v(p[i + 1]), s.rhie_chow_on_off_l);
+        f.u_r = face_velocity<T>(v(s.u_l[i]), v(s.u_l[i + 1]), f.invb_r,
+            v(p[i - 1]), v(p[i]), v(p[i + 1]), v(p[i + 2]), s.rhie_chow_on_off_l);
+
+        return f;
     }
 
-	const double u_inlet_value = in.u_inlet_value;          // Inlet velocity [m/s]
-	const double u_outlet_value = in.u_outlet_value;        // Outlet velocity [m/s]
-	const bool u_inlet_bc = in.u_inlet_bc;                  // Inlet velocity BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
-	const bool u_outlet_bc = in.u_outlet_bc;                // Outlet velocity BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    // On the fields themselves, for the assemblies
+    template <typename S>
+    auto cell_faces(const S& s, int i) {
+        using Real = std::decay_t<decltype(s.rho_l)>;
+        return cell_faces<Real>(s, i, [](const Real& x) -> const Real& { return x; });
+    }
 
-	const double T_inlet_value = in.T_inlet_value;          // Inlet temperature [K]
-	const double T_outlet_value = in.T_outlet_value;        // Outlet temperature [K]
-	const bool T_inlet_bc = in.T_inlet_bc;                  // Inlet temperature BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
-	const bool T_outlet_bc = in.T_outlet_bc;                // Outlet temperature BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    // On their values, for the residuals, which only steer the iterations
+    template <typename S>
+    CellFaces<double> cell_face_values(const S& s, int i) {
+        return cell_faces<double>(s, i, [](const auto& x) { return dual::value(x); });
+    }
 
-	const double p_inlet_value = in.p_inlet_value;          // Inlet pressure [Pa]
-	const double p_outlet_value = in.p_outlet_value;        // Outlet pressure [Pa]
-	const bool p_inlet_bc = in.p_inlet_bc;                  // Inlet pressure BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
-	const bool p_outlet_bc = in.p_outlet_bc;                // Outlet pressure BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    // Momentum matrix: upwind convection of the face mass fluxes, central
+    // diffusion, DarcyForchheimer drag, and the boundary rows
+    template <typename S>
+    void momentum_matrix(S& s) {
 
-	const double z_evap_start = in.z_evap_start;                        // Evaporation zone start and end [m]
-	const double z_evap_end = in.z_evap_end;                            // Evaporation zone start and end [m]
+        using Real = std::decay_t<decltype(s.rho_l)>;
+        const int N = s.N;
 
-	const double z_cond_start = in.z_cond_start;                        // Evaporation zone start and end [m]
-	const double z_cond_end = in.z_cond_end;                            // Condensation zone start and end [m]
+        for (int i = 1; i < N - 1; ++i) {
 
-	const double L_evap = z_evap_end - z_evap_start;                    // Length of the evaporation zone [m]
-	const double L_cond = z_cond_end - z_cond_start;                    // Length of the condensation zone [m]
+            const Real D_l = s.mu / s.dz;       // [kg/(m2s)]
+            const Real D_r = s.mu / s.dz;       // [kg/(m2s)]
 
-    std::vector<double> aLU(N, 0.0);                                    // Lower tridiagonal coefficient for velocity
-    std::vector<double> bLU(N, rho_l * dz / dt_user + 2 * mu / dz);     // Central tridiagonal coefficient for velocity
-    std::vector<double> cLU(N, 0.0);                                    // Upper tridiagonal coefficient for velocity
-    std::vector<double> dLU(N, 0.0);                                    // Known vector coefficient for velocity
+            const CellFaces<Real> f = cell_faces(s, i);
 
-	std::vector<double> aLP(N, 0.0);                                    // Lower tridiagonal coefficient for pressure
-	std::vector<double> bLP(N, 0.0);                                    // Central tridiagonal coefficient for pressure
-	std::vector<double> cLP(N, 0.0);                                    // Upper tridiagonal coefficient for pressure
-	std::vector<double> dLP(N, 0.0);                                    // Known vector coefficient for pressure
+            const Real F_l = s.rho_l * f.u_l;   // [kg/(m2s)]
+            const Real F_r = s.rho_l * f.u_r;   // [kg/(m2s)]
 
-	std::vector<double> aLT(N, 0.0);                                    // Lower tridiagonal coefficient for temperature
-	std::vector<double> bLT(N, 0.0);                                    // Central tridiagonal coefficient for temperature
-	std::vector<double> cLT(N, 0.0);                                    // Upper tridiagonal coefficient for temperature
-	std::vector<double> dLT(N, 0.0);                                    // Known vector coefficient for temperature
+            const Upwind<Real> c = upwind(F_l, F_r, D_l, D_r);
 
-    const double K = 1e-8;
-	const double CF = 1e-4;
+            s.aLU[i] = c.a;                             // [kg/(m2s)]
+            s.cLU[i] = c.c;                             // [kg/(m2s)]
+            s.bLU[i] =
+                + c.outflow
+                + s.rho_l * s.dz / s.dt
+                + D_l + D_r
+                + drag(s, dual::abs(s.u_l[i]), s.dz)
+                ;                            // [kg/(m2s)]
+        }
 
-    fs::path inputPath(inputFile);
-    std::string caseName = inputPath.filename().string();
-    fs::path outputDir = fs::path("output") / caseName;
-    fs::create_directories(outputDir);
+        /// Diffusion coefficients for the first and last node to define BCs
+        const Real D_first = s.mu / s.dz;
+        const Real D_last = s.mu / s.dz;
 
-    std::ofstream v_out(outputDir / in.velocity_file);              // Velocity output file
-    std::ofstream p_out(outputDir / in.pressure_file);              // Pressure output file
-    std::ofstream T_out(outputDir / in.temperature_file);           // Temperature output file
+        /// Velocity BCs needed variables for the first node
+        const Real u_r_face_first = 0.5 * (s.u_l[1]);
+        const Real F_r_first = s.rho_l * u_r_face_first;
 
-    // Convergence metrics
-	double continuity_residual = 1.0;
-    double momentum_residual = 1.0;
-	double energy_residual = 1.0;
+        /// Velocity BCs needed variables for the last node
+        const Real u_l_face_last = 0.5 * (s.u_l[N - 2]);
+        const Real F_l_last = s.rho_l * u_l_face_last;
 
-    double u_error_l = 1.0;
-    int outer_l = 0;
+        const BoundaryRow<Real> first = boundary_row(s.u_inlet_bc,
+            Real(momentum_boundary_diagonal(s, D_first, F_r_first, s.dz)), s.u_inlet_value);
+        const BoundaryRow<Real> last = boundary_row(s.u_outlet_bc,
+            Real(momentum_boundary_diagonal(s, D_last, -F_l_last, s.dz)), s.u_outlet_value);
 
-    double p_error_l = 1.0;
-    double rho_error_l = 1.0;
-    int inner_l = 0;
+        s.aLU[0] = 0.0;
+        s.bLU[0] = first.diag;
+        s.cLU[0] = first.neighbour;
 
-    double start = omp_get_wtime();
+        s.aLU[N - 1] = last.neighbour;
+        s.bLU[N - 1] = last.diag;
+        s.cLU[N - 1] = 0.0;
+    }
 
-	// Time-stepping loop
-    for (int n = 0; n <= time_steps; ++n) {
+    // Right-hand side of the momentum equation, the only part depending on
+    // the pressure and the old time level
+    template <typename S>
+    void momentum_rhs(S& s) {
 
-        // Saving old variables
-        u_l_old = u_l;
-        T_l_old = T_l;
-        p_l_old = p_l;
+        const int N = s.N;
 
-        u_error_l = 1.0;
-        outer_l = 0;
+        for (int i = 1; i < N - 1; ++i) {
+            s.dLU[i] = momentum_source(s, s.p_l[i - 1], s.p_l[i + 1], s.u_l_old[i], 1.0, s.dz);     // [kg/(ms2)]
+        }
 
-        momentum_residual = 1.0;
-        energy_residual = 1.0;
+        s.dLU[0] = boundary_row(s.u_inlet_bc, s.bLU[0], s.u_inlet_value).rhs;
+        s.dLU[N - 1] = boundary_row(s.u_outlet_bc, s.bLU[N - 1], s.u_outlet_value).rhs;
+    }
 
-        while (outer_l < tot_outer_l && (momentum_residual > outer_tol_l || energy_residual > outer_tol_l)) {
+    // Energy equation for T (implicit), upwind convection, central
+    // diffusion. The face velocities go to u_face_l. Returns whether they
+    // came out uniform, which makes the interior rows alike: never for
+    // derivative-carrying scalars, whose comparisons look at the value alone.
+    template <typename S>
+    bool energy_system(S& s) {
 
-            // ===========================================================
-            // MOMENTUM PREDICTOR
-            // ===========================================================
+        using Real = std::decay_t<decltype(s.rho_l)>;
+        const int N = s.N;
 
-            for (int i = 1; i < N - 1; ++i) {
+        bool uniform = std::is_same<Real, double>::value;
 
-                const double D_l = mu / dz;       // [kg/(m2s)]
-                const double D_r = mu / dz;       // [kg/(m2s)]
-
-                const double avgInvbLU_L = 0.5 * (1.0 / bLU[i - 1] + 1.0 / bLU[i]); // [m2s/kg]
-                const double avgInvbLU_R = 0.5 * (1.0 / bLU[i + 1] + 1.0 / bLU[i]); // [m2s/kg]
-
-                // RhieChow corrections for face velocities
-                const double rc_l = -avgInvbLU_L / 4.0 *
-                    (p_padded_l[i - 2] - 3.0 * p_padded_l[i - 1] + 3.0 * p_padded_l[i] - p_padded_l[i + 1]); // [m/s]
-                const double rc_r = -avgInvbLU_R / 4.0 *
-                    (p_padded_l[i - 1] - 3.0 * p_padded_l[i] + 3.0 * p_padded_l[i + 1] - p_padded_l[i + 2]); // [m/s]
-
-                // Face velocities (avg + RC)
-                const double u_l_face = 0.5 * (u_l[i - 1] + u_l[i]) + rhie_chow_on_off_l * rc_l;    // [m/s]
-                const double u_r_face = 0.5 * (u_l[i] + u_l[i + 1]) + rhie_chow_on_off_l * rc_r;    // [m/s]
-
-                const double F_l = rho_l * u_l_face; // [kg/(m2s)]
-                const double F_r = rho_l * u_r_face; // [kg/(m2s)]
-
-                const double f = +mu / K * dz + rho_l * CF * std::abs(u_l[i]) / std::sqrt(K) * dz;
-
-                aLU[i] =
-                    - std::max(F_l, 0.0)
-                    - D_l;                                  // [kg/(m2s)]
-                cLU[i] =
-                    - std::max(-F_r, 0.0)
-                    - D_r;                                  // [kg/(m2s)]
-                bLU[i] =
-                    + std::max(F_r, 0.0)
-                    + std::max(-F_l, 0.0)
-                    + rho_l * dz / dt
-                    + D_l + D_r
-                    + f
-                    ;                            // [kg/(m2s)]
-                dLU[i] =
-                    - 0.5 * (p_l[i + 1] - p_l[i - 1])
-                    + rho_l * u_l_old[i] * dz / dt;         // [kg/(ms2)]
-            }
+        s.for_interior_cells([&](int i, const Real& S_m_i, const Real& S_h_i) {
 
-            /// Diffusion coefficients for the first and last node to define BCs
-            const double D_first = mu / dz;
-            const double D_last = mu / dz;
-
-            /// Velocity BCs needed variables for the first node
-            const double u_r_face_first = 0.5 * (u_l[1]);
-            const double F_r_first = rho_l * u_r_face_first;
-
-            /// Velocity BCs needed variables for the last node
-            const double u_l_face_last = 0.5 * (u_l[N - 2]);
-            const double F_l_last = rho_l * u_l_face_last;
-
-			if (u_inlet_bc == 0) {                               // Dirichlet BC
-                aLU[0] = 0.0;
-                bLU[0] = rho_l * dz / dt + 2 * D_first + F_r_first;
-                cLU[0] = 0.0;
-                dLU[0] = bLU[0] * u_inlet_value;
-			}
-			else if (u_inlet_bc == 1) {                          // Neumann BC
-                aLU[0] = 0.0;
-                bLU[0] = + (rho_l * dz / dt + 2 * D_first + F_r_first);
-                cLU[0] = - (rho_l * dz / dt + 2 * D_first + F_r_first);
-                dLU[0] = 0.0;
-			}
-
-			if (u_outlet_bc == 0) {                              // Dirichlet BC
-                aLU[N - 1] = 0.0;
-                bLU[N - 1] = + (rho_l * dz / dt + 2 * D_last - F_l_last);
-                cLU[N - 1] = 0.0;
-                dLU[N - 1] = bLU[N - 1] * u_outlet_value;
-            }
-			else if (u_outlet_bc == 1) {                          // Neumann BC
-                aLU[N - 1] = - (rho_l * dz / dt + 2 * D_last - F_l_last);
-                bLU[N - 1] = + (rho_l * dz / dt + 2 * D_last - F_l_last);
-                cLU[N - 1] = 0.0;
-                dLU[N - 1] = 0.0;
-            }
+            const Real D_l = s.k / (s.rho_l * s.cp * s.dz);      /// [W/(m2 K)]
+            const Real D_r = s.k / (s.rho_l * s.cp * s.dz);      /// [W/(m2 K)]
 
-            u_l = tdma::solve(aLU, bLU, cLU, dLU);
+            const CellFaces<Real> f = cell_faces(s, i);
 
-            // ===============================================================
-            // TEMPERATURE SOLVER
-            // ===============================================================
+            s.u_face_l[i] = f.u_l;
+            s.u_face_l[i + 1] = f.u_r;
 
-            // Energy equation for T (implicit), upwind convection, central diffusion
-            for (int i = 1; i < N - 1; i++) {
+            if constexpr (std::is_same<Real, double>::value) uniform = uniform && f.u_l == f.u_r;
 
-                const double D_l = k / (rho_l * cp * dz);      /// [W/(m2 K)]
-                const double D_r = k / (rho_l * cp * dz);      /// [W/(m2 K)]
+            const Upwind<Real> c = upwind(f.u_l, f.u_r, D_l, D_r);
 
-                const double avgInvbLU_L = 0.5 * (1.0 / bLU[i - 1] + 1.0 / bLU[i]);     // [m2s/kg]
-                const double avgInvbLU_R = 0.5 * (1.0 / bLU[i + 1] + 1.0 / bLU[i]);     // [m2s/kg]
+            s.aLT[i] = c.a;                             /// [W/(m2 K)]
+            s.cLT[i] = c.c;                             /// [W/(m2 K)]
+            s.bLT[i] =
+                + c.outflow
+                + D_l + D_r
+                + s.dz / s.dt
+                ;                              /// [W/(m2 K)]
 
-                const double rc_l = -avgInvbLU_L / 4.0 *
-                    (p_padded_l[i - 2] - 3.0 * p_padded_l[i - 1] + 3.0 * p_padded_l[i] - p_padded_l[i + 1]);    // [m/s]
-                const double rc_r = -avgInvbLU_R / 4.0 *
-                    (p_padded_l[i - 1] - 3.0 * p_padded_l[i] + 3.0 * p_padded_l[i + 1] - p_padded_l[i + 2]);    // [m/s]
+            s.dLT[i] = energy_source(s, s.T_l_old[i], S_m_i, S_h_i, s.dz);     /// [W/m2]
+        });
 
-                const double u_l_face = 0.5 * (u_l[i - 1] + u_l[i]) + rhie_chow_on_off_l * rc_l;         // [m/s]
-                const double u_r_face = 0.5 * (u_l[i] + u_l[i + 1]) + rhie_chow_on_off_l * rc_r;         // [m/s]
+        // BCs on temperature
+        const BoundaryRow<Real> first = boundary_row(s.T_inlet_bc, Real(1.0), s.T_inlet_value);
+        const BoundaryRow<Real> last = boundary_row(s.T_outlet_bc, Real(1.0), s.T_outlet_value);
 
-                aLT[i] =
-                    - D_l
-                    - std::max(u_l_face, 0.0)
-                    ;              /// [W/(m2 K)]
+        s.aLT[0] = 0.0;
+        s.bLT[0] = first.diag;
+        s.cLT[0] = first.neighbour;
+        s.dLT[0] = first.rhs;
 
-                cLT[i] =
-                    - D_r
-                    - std::max(-u_r_face, 0.0)
-                    ;            /// [W/(m2 K)]
+        s.aLT[N - 1] = last.neighbour;
+        s.bLT[N - 1] = last.diag;
+        s.cLT[N - 1] = 0.0;
+        s.dLT[N - 1] = last.rhs;
 
-                bLT[i] =
-                    + std::max(u_r_face, 0.0)
-                    + std::max(-u_l_face, 0.0)
-                    + D_l + D_r
-                    + dz / dt
-                    ;                              /// [W/(m2 K)]
+        return uniform;
+    }
 
-                dLT[i] =
-                    + dz / dt * T_l_old[i]
-                    + S_h[i] * dz
-					+ S_m[i] * T_l_old[i] * dz / rho_l
-                    ;                          /// [W/m2]
-            }
+    // Right-hand side of the pressure correction, and with `matrix` its
+    // symmetric matrix, which only depends on the momentum diagonal
+    template <typename S>
+    void pressure_correction_system(S& s, bool matrix) {
 
-            // BCs on temperature
-            if (T_inlet_bc == 0) {                          // Dirichlet BC
+        using Real = std::decay_t<decltype(s.rho_l)>;
+        const int N = s.N;
 
-                aLT[0] = 0.0;
-                bLT[0] = 1.0;
-                cLT[0] = 0.0;
-                dLT[0] = T_inlet_value;
-            }
-            else if (T_inlet_bc == 1) {                     // Neumann BC
+        s.for_interior_cells([&](int i, const Real& S_m_i, const Real&) {
 
-                aLT[0] = 0.0;
-                bLT[0] = 1.0;
-                cLT[0] = -1.0;
-                dLT[0] = 0.0;
-            }
+            const CellFaces<Real> f = cell_faces(s, i);
 
-            if (T_outlet_bc == 0) {                         // Dirichlet BC
+            const Real phi_l = s.rho_l * f.u_l;     // [kg/(m2s)]
+            const Real phi_r = s.rho_l * f.u_r;     // [kg/(m2s)]
 
-                aLT[N - 1] = 0.0;
-                bLT[N - 1] = 1.0;
-                cLT[N - 1] = 0.0;
-                dLT[N - 1] = T_outlet_value;
-            }
-            else if (T_outlet_bc == 1) {                    // Neumann BC
+            const Real mass_imbalance = (phi_r - phi_l);  // [kg/(m2s)]
 
-                aLT[N - 1] = -1.0;
-                bLT[N - 1] = 1.0;
-                cLT[N - 1] = 0.0;
-                dLT[N - 1] = 0.0;
-            }
+            const Real mass_flux = S_m_i * s.dz;    // [kg/(m2s)]
 
-            T_prev = T_l;
-            T_l = tdma::solve(aLT, bLT, cLT, dLT);
+            s.dLP[i] = + mass_flux - mass_imbalance;  /// [kg/(m2s)]
 
-            rho_error_l = 1.0;
-            p_error_l = 1.0;
-            inner_l = 0;
+            if (!matrix) return;
 
-            continuity_residual = 1.0;
+            const Real E_l = s.rho_l * f.invb_l / s.dz; // [s/m]
+            const Real E_r = s.rho_l * f.invb_r / s.dz; // [s/m]
 
-            while (inner_l < tot_inner_l && continuity_residual > inner_tol_l) {
+            // Face i - 1/2 is shared with row i - 1, which stores it as its -E_r
+            s.LP.off[i] =
+                - E_r
+                ;               /// [s/m]
 
-                // -------------------------------------------------------
-                // CONTINUITY SATISFACTOR: assemble pressure correction
-                // -------------------------------------------------------
+            s.LP.diag[i] =
+                + E_l
+                + E_r
+                ;               /// [s/m]
+        });
 
-                for (int i = 1; i < N - 1; ++i) {
+        s.dLP[0] = 0.0;
+        s.dLP[N - 1] = 0.0;
 
-                    const double avgInvbLU_L = 0.5 * (1.0 / bLU[i - 1] + 1.0 / bLU[i]);     // [m2s/kg]
-                    const double avgInvbLU_R = 0.5 * (1.0 / bLU[i + 1] + 1.0 / bLU[i]);     // [m2s/kg]
+        if (!matrix) return;
 
-                    const double rc_l = -avgInvbLU_L / 4.0 *
-                        (p_padded_l[i - 2] - 3.0 * p_padded_l[i - 1] + 3.0 * p_padded_l[i] - p_padded_l[i + 1]);    // [m/s]
-                    const double rc_r = -avgInvbLU_R / 4.0 *
-                        (p_padded_l[i - 1] - 3.0 * p_padded_l[i] + 3.0 * p_padded_l[i + 1] - p_padded_l[i + 2]);    // [m/s]
+        // BCs on p_prime. Dirichlet rows fix p_prime = 0 and drop the coupling
+        // to the neighbour, where it only multiplies that zero; Neumann rows
+        // p_prime_0 = p_prime_1 are scaled by the face coefficient, so the
+        // matrix stays symmetric.
+        const Real E_first = s.rho_l * face_inverse_diagonal(s.bLU[0], s.bLU[1]) / s.dz;             // [s/m]
+        const Real E_last = s.rho_l * face_inverse_diagonal(s.bLU[N - 1], s.bLU[N - 2]) / s.dz;      // [s/m]
 
-                    const double u_l_star = 0.5 * (u_l[i - 1] + u_l[i]) + rhie_chow_on_off_l * rc_l;    // [m/s]
-                    const double u_r_star = 0.5 * (u_l[i] + u_l[i + 1]) + rhie_chow_on_off_l * rc_r;    // [m/s]
+        if (s.p_inlet_bc == 0) {                            // Dirichlet BC
+            s.LP.diag[0] = 1.0;
+            s.LP.off[0] = 0.0;
+        }
+        else if (s.p_inlet_bc == 1) {                       // Neumann BC
+            s.LP.diag[0] = E_first;
+            s.LP.off[0] = -E_first;
+        }
 
-                    const double phi_l = rho_l * u_l_star;   // [kg/(m2s)]
-                    const double phi_r = rho_l * u_r_star;   // [kg/(m2s)]
+        if (s.p_outlet_bc == 0) {                           // Dirichlet BC
+            s.LP.diag[N - 1] = 1.0;
+            s.LP.off[N - 2] = 0.0;
+        }
+        else if (s.p_outlet_bc == 1) {                      // Neumann BC
+            s.LP.diag[N - 1] = E_last;
+            s.LP.off[N - 2] = -E_last;
+        }
+    }
 
-                    const double mass_imbalance = (phi_r - phi_l);  // [kg/(m2s)]
+    // BCs on the corrected pressure, with the ghost values of its padded storage
+    template <typename S>
+    void pressure_boundaries(S& s) {
 
-                    const double mass_flux = S_m[i] * dz;         // [kg/(m2s)]
+        const int N = s.N;
 
-                    const double E_l = rho_l * avgInvbLU_L / dz; // [s/m]
-                    const double E_r = rho_l * avgInvbLU_R / dz; // [s/m]
+        if (s.p_inlet_bc == 0) {                            // Dirichlet BC
 
-                    aLP[i] =
-                        - E_l
-                        ;               /// [s/m]
+            s.p_l[0] = s.p_inlet_value;
+            s.p_storage_l[N + 1] = s.p_inlet_value;
+        }
+        else if (s.p_inlet_bc == 1) {                       // Neumann BC
 
-                    cLP[i] =
-                        - E_r
-                        ;               /// [s/m]
+            s.p_l[0] = s.p_l[1];
+            s.p_storage_l[0] = s.p_storage_l[1];
+        }
 
-                    bLP[i] =
-                        + E_l 
-                        + E_r
-                        ;               /// [s/m]
+        if (s.p_outlet_bc == 0) {                           // Dirichlet BC
 
-                    dLP[i] = + mass_flux - mass_imbalance;  /// [kg/(m2s)]
-                }
+            s.p_l[N - 1] = s.p_outlet_value;
+            s.p_storage_l[N + 1] = s.p_outlet_value;
+        }
+        else if (s.p_outlet_bc == 1) {                      // Neumann BC
 
-                // BCs on p_prime
-                if (p_inlet_bc == 0) {                               // Dirichlet BC
-                    aLP[0] = 0.0;
-                    bLP[0] = 1.0;
-                    cLP[0] = 0.0;
-                    dLP[0] = 0.0;
-                }
-                else if (p_inlet_bc == 1) {                          // Neumann BC
-                    aLP[0] = 0.0;
-                    bLP[0] = 1.0;
-                    cLP[0] = -1.0;
-                    dLP[0] = 0.0;
-                }
+            s.p_l[N - 1] = s.p_l[N - 2];
+            s.p_storage_l[N + 1] = s.p_storage_l[N];
+        }
+    }
 
-                if (p_outlet_bc == 0) {                              // Dirichlet BC
-                    aLP[N - 1] = 0.0;
-                    bLP[N - 1] = 1.0;
-                    cLP[N - 1] = 0.0;
-                    dLP[N - 1] = 0.0;
-                }
-                else if (p_outlet_bc == 1) {                          // Neumann BC
-                    aLP[N - 1] = -1.0;
-                    bLP[N - 1] = 1.0;
-                    cLP[N - 1] = 0.0;
-                    dLP[N - 1] = 0.0;
-                }
+    // Velocity correction of interior cell i from the pressure correction
+    template <typename S>
+    auto velocity_correction(const S& s, int i) {
+        return velocity_correction(s.p_prime_l[i - 1], s.p_prime_l[i + 1], s.bLU[i]);
+    }
 
-                p_prime_l = tdma::solve(aLP, bLP, cLP, dLP);
+    // Continuity residual of the interior cells
+    template <typename S>
+    double continuity_residual(const S& s) {
 
-                // -------------------------------------------------------
-                // PRESSURE CORRECTOR
-                // -------------------------------------------------------
+        using Real = std::decay_t<decltype(s.rho_l)>;
+        auto v = [](const auto& x) { return dual::value(x); };
 
-                p_error_l = 0.0;
+        ContinuityResidual residual;
 
-                for (int i = 0; i < N; ++i) {
+        s.for_interior_cells([&](int i, const Real& S_m_i, const Real&) {
 
-                    p_prev[i] = p_l[i];
-                    p_l[i] += p_prime_l[i];
+            const CellFaces<double> f = cell_face_values(s, i);
 
-                    p_storage_l[i + 1] = p_l[i];
-                    p_error_l = std::max(p_error_l, std::fabs(p_l[i] - p_prev[i]));
-                }
+            const double phi_l = v(s.rho_l) * f.u_l;     // [kg/(m2s)]
+            const double phi_r = v(s.rho_l) * f.u_r;     // [kg/(m2s)]
 
-                // BCs on pressure
-                if (p_inlet_bc == 0) {                              // Dirichlet BC
+            const double mass_imbalance = (phi_r - phi_l);    // [kg/(m2s)]
 
-					p_l[0] = p_inlet_value;
-                    p_storage_l[N + 1] = p_inlet_value;
-                }
-                else if (p_inlet_bc == 1) {                         // Neumann BC
+            const double mass_flux = v(S_m_i) * s.dz;     // [kg/(m2s)]
 
-					p_l[0] = p_l[1];
-                    p_storage_l[0] = p_storage_l[1];
-                }
+            const double u_l_face = 0.5 * (v(s.u_l[i - 1]) + v(s.u_l[i]));
+            const double u_r_face = 0.5 * (v(s.u_l[i]) + v(s.u_l[i + 1]));
 
-                if (p_outlet_bc == 0) {                              // Dirichlet BC
+            residual.face(v(s.rho_l) * u_l_face);
+            residual.face(v(s.rho_l) * u_r_face);
 
-					p_l[N - 1] = p_outlet_value;
-                    p_storage_l[N + 1] = p_outlet_value;
-                }
-                else if (p_outlet_bc == 1) {                         // Neumann BC
+            residual.cell(mass_flux, mass_imbalance);
+        });
 
-					p_l[N - 1] = p_l[N - 2];
-                    p_storage_l[N + 1] = p_storage_l[N];
-                }
+        return residual.value();
+    }
 
-                // -------------------------------------------------------
-                // VELOCITY CORRECTOR
-                // -------------------------------------------------------
+    // Largest momentum residual of the interior cells relative to the
+    // largest of the inertial, unsteady and viscous reference forces
+    template <typename S>
+    double momentum_residual(const S& s) {
 
-                u_error_l = 0.0;
+        auto v = [](const auto& x) { return dual::value(x); };
+        const int N = s.N;
 
-                for (int i = 1; i < N - 1; ++i) {
-                    u_prev[i] = u_l[i];
-                    u_l[i] -= (p_prime_l[i + 1] - p_prime_l[i - 1]) / (2.0 * bLU[i]);
-                    u_error_l = std::max(u_error_l, std::fabs(u_l[i] - u_prev[i]));
-                }
+        double U_ref = 0.0;
+        for (int i = 0; i < N; ++i)
+            U_ref = std::max(U_ref, std::abs(v(s.u_l[i])));
 
-                // -------------------------------------------------------
-				// CONTINUITY RESIDUAL CALCULATION
-                // -------------------------------------------------------
+        const double F_ref = momentum_scale(s, U_ref);
 
-                double phi_ref = 0.0;
-                double Sm_ref = 0.0;
+        double residual = 0.0;
 
-                for (int i = 1; i < N - 1; ++i) {
+        for (int i = 1; i < N - 1; ++i) {
 
-                    const double u_l_face = 0.5 * (u_l[i - 1] + u_l[i]);
-                    const double u_r_face = 0.5 * (u_l[i] + u_l[i + 1]);
+            const CellFaces<double> f = cell_face_values(s, i);
 
-                    phi_ref = std::max(phi_ref, rho_l * std::abs(u_l_face));
-                    phi_ref = std::max(phi_ref, rho_l * std::abs(u_r_face));
+            const double D_l = v(s.mu) / s.dz;
+            const double D_r = v(s.mu) / s.dz;
 
-                    Sm_ref = std::max(Sm_ref, std::abs(S_m[i] * dz));
-                }
+            const double F_l = v(s.rho_l) * f.u_l;
+            const double F_r = v(s.rho_l) * f.u_r;
+
+            const double accum =
+                v(s.rho_l) * s.dz / s.dt * (v(s.u_l[i]) - v(s.u_l_old[i]));
+
+            const double conv =
+                F_r * f.u_r - F_l * f.u_l;
 
-                const double cont_ref = std::max({ phi_ref, Sm_ref, 1e-30 });
+            const double diff =
+                D_r * (v(s.u_l[i + 1]) - v(s.u_l[i]))
+                - D_l * (v(s.u_l[i]) - v(s.u_l[i - 1]));
 
-                continuity_residual = 0.0;
+            const double press =
+                0.5 * (v(s.p_l[i + 1]) - v(s.p_l[i - 1]));
 
-                for (int i = 1; i < N - 1; ++i) {
+            const double R =
+                accum + conv - diff + press;
 
-                    const double avgInvbLU_L = 0.5 * (1.0 / bLU[i - 1] + 1.0 / bLU[i]);     // [m2s/kg]
-                    const double avgInvbLU_R = 0.5 * (1.0 / bLU[i + 1] + 1.0 / bLU[i]);     // [m2s/kg]
+            residual = std::max(residual, std::abs(R) / F_ref);
+        }
+
+        return residual;
+    }
+}
 
-                    const double rc_l = -avgInvbLU_L / 4.0 *
-                        (p_padded_l[i - 2] - 3.0 * p_padded_l[i - 1] + 3.0 * p_padded_l[i] - p_padded_l[i + 1]);    // [m/s]
-                    const double rc_r = -avgInvbLU_R / 4.0 *
-                        (p_padded_l[i - 1] - 3.0 * p_padded_l[i] + 3.0 * p_padded_l[i + 1] - p_padded_l[i + 2]);    // [m/s]
+// 1D PISO solver. Real is the scalar type of the fields, coefficients and
+// physical parameters: double for plain runs, a dual number to carry the
+// derivatives of the solution with respect to seeded parameters, a taped
+// adjoint::Var to record steps for the adjoint. Iteration control
+// (tolerances, residuals) always works on the values.
+template <typename Real>
+struct BasicSolver {
 
-                    const double u_l_star = 0.5 * (u_l[i - 1] + u_l[i]) + rhie_chow_on_off_l * rc_l;    // [m/s]
-                    const double u_r_star = 0.5 * (u_l[i] + u_l[i + 1]) + rhie_chow_on_off_l * rc_r;    // [m/s]
+    int    N = 0;                           // Number of cells [-]
+    double L = 0.0;                         // Length of the domain [m]
+    double dz = 0.0;                        // Cell size [m]
+    double dt = 0.0;                        // Time step [s]
+
+    int    tot_outer_l = 0;                 // PISO outer iterations [-]
+    int    tot_inner_l = 0;                 // PISO inner iterations [-]
+    double outer_tol_l = 0.0;               // PISO outer tolerance [-]
+    double inner_tol_l = 0.0;               // PISO inner tolerance [-]
+    bool   rhie_chow_on_off_l = true;       // RhieChow interpolation on/off (1/0) [-]
+    bool   task_graph = true;               // Concurrent execution of independent phases on/off (1/0) [-]
+    bool   speculative_inner = false;       // Speculative inner iterations on/off (1/0) [-]
+
+    ResidualSchedule inner_check;           // When the continuity residual is evaluated
+    ResidualSchedule outer_check;           // When the momentum and energy residuals are evaluated
+    bool   check_outer = true;              // Residuals evaluated in the current outer iteration [-]
+
+    bool   inner_tol_adaptive = false;      // Inner tolerance tied to the outer residual on/off (1/0) [-]
+    double inner_tol_max = 0.0;             // Loosest adaptive inner tolerance [-]
+    double forcing_max = 0.0;               // Largest forcing term [-]
+    double forcing_l = 0.0;                 // Current forcing term [-]
+    double outer_residual_last = 0.0;       // Outer residual the forcing term was last computed from [-]
+    bool   outer_residual_fresh = true;     // Momentum residual evaluated since the forcing term was last updated [-]
+    double inner_tol_eff = 0.0;             // Inner tolerance used by the current outer iteration [-]
+    double inner_rate_l = 0.0;              // Latest measured contraction of the continuity residual per inner iteration [-]
+    double momentum_freeze_tol = 0.0;       // Relative change of face mass flux and velocity keeping the momentum matrix, 0 for never [-]
+
+    int    step_budget = 0;                 // Linear solves per time step, 0 for no budget [-]
+    double step_time_budget = 0.0;          // Wall time per time step, 0 for no budget [s]
+    double solve_time_l = 0.0;              // Average wall time per linear solve over the past steps [s]
+    bool   budgeted_l = false;              // Current step runs on a budget [-]
+    int    step_solves_l = 0;               // Linear solves granted to the current step [-]
+    double step_start_l = 0.0;              // Wall time at the start of the current step [s]
+    int    budget_l = 0;                    // Linear solves left in the current step [-]
+    int    inner_cap_l = 0;                 // Inner iterations allowed in the current outer iteration [-]
+    bool   step_converged = true;           // Last step met the outer tolerance [-]
+    double best_residual_l = 0.0;           // Lowest outer residual of the current step [-]
+    bool   best_ahead_l = false;            // Last evaluated iterate worse than the kept one [-]
+
+    // Iterate of the lowest outer residual, with the momentum diagonal and the
+    // residuals that belong to it
+    struct {
+        std::vector<Real> u, p, T, bLU;
+        std::vector<std::vector<Real>> phi;
+        double continuity_residual = 0.0;
+        double momentum_residual = 0.0;
+        double energy_residual = 0.0;
+    } best_l;
+
+    Real   rho_l = 0.0;                     // Density [kg/m3]
+    Real   mu = 0.0;                        // Dynamic viscosity [kg/(m s)]
+    Real   k = 0.0;                         // Thermal diffusivity [m2/s]
+    Real   cp = 0.0;                        // Specific heat capacity at constant pressure [J/kgK]
+
+    Real   u_inlet_value = 0.0;             // Inlet velocity [m/s]
+    Real   u_outlet_value = 0.0;            // Outlet velocity [m/s]
+    bool   u_inlet_bc = 0;                  // Inlet velocity BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   u_outlet_bc = 0;                 // Outlet velocity BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    Real   T_inlet_value = 0.0;             // Inlet temperature [K]
+    Real   T_outlet_value = 0.0;            // Outlet temperature [K]
+    bool   T_inlet_bc = 0;                  // Inlet temperature BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   T_outlet_bc = 0;                 // Outlet temperature BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    Real   p_inlet_value = 0.0;             // Inlet pressure [Pa]
+    Real   p_outlet_value = 0.0;            // Outlet pressure [Pa]
+    bool   p_inlet_bc = 0;                  // Inlet pressure BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   p_outlet_bc = 0;                 // Outlet pressure BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    const double K = 1e-8;
+    const double CF = 1e-4;
+
+    double time_total = 0.0;                // Simulated time [s]
+    Signals signals;                        // Tabulated boundary values and source strengths
+
+    bool   statistics_on = false;           // Running statistics of u, p and T on/off (1/0) [-]
+    double statistics_start = 0.0;          // Statistics window [s]
+    double statistics_end = 0.0;            // [s]
+    statistics::Running u_stats, p_stats, T_stats;
+
+    std::vector<Real> u_l;                  // Velocity field [m/s]
+    std::vector<Real> T_l;                  // Temperature field [K]
+    std::vector<Real> p_l;                  // Pressure field [Pa]
+
+    std::vector<Real> u_l_old;              // Previous time step velocity [m/s]
+    std::vector<Real> T_l_old;              // Previous time step temperature [K]
+    std::vector<Real> p_l_old;              // Previous time step pressure [Pa]
+
+    std::vector<Real> p_prime_l;            // Pressure correction [Pa]
+    std::vector<Real> p_prime_spec_l;       // Speculative pressure correction of the next inner iteration [Pa]
+    std::vector<Real> p_storage_l;          // Padded pressure storage for RhieChow [Pa]
+    Real*   p_padded_l = nullptr;           // Pointer to the real nodes of the padded pressure storage [Pa]
+
+    std::vector<Real> u_prev;               // Previous iteration velocity for convergence check [m/s]
+    std::vector<Real> p_prev;               // Previous iteration pressure for convergence check [Pa]
+    std::vector<Real> T_prev;               // Previous iteration temperature for convergence check [K]
+
+    std::vector<sources::BasicZone<Real>> zones;    // Evaporation and condensation zones
+    std::vector<sources::Segment> source_segments;  // Interior cells split into source-free and zone segments
+    std::vector<Real> S_m_added, S_h_added; // Per-cell additions to the zone sources, empty for none
+
+    std::vector<Real> aLU, bLU, cLU, dLU;   // Tridiagonal coefficients for velocity
+    tdma::Symmetric<Real> LP;               // Symmetric tridiagonal matrix for pressure
+    std::vector<Real> dLP;                  // Right-hand side for pressure
+    std::vector<Real> aLT, bLT, cLT, dLT;   // Tridiagonal coefficients for temperature
+
+    std::vector<Real> u_face_l;             // Face velocities of the energy assembly, face i between cells i - 1 and i [m/s]
+
+    // Energy matrix whose interior rows are all alike (uniform face
+    // velocities), kept with its converged elimination multipliers for as
+    // long as it recurs
+    tdma::Toeplitz<Real> T_toeplitz;
+    bool   T_uniform = false;               // The assembled energy rows 1 to N - 2 are alike [-]
+
+    // The pressure-correction matrix only depends on the momentum diagonal:
+    // assembled and factored once per momentum assembly, then reused by all
+    // the inner iterations. Where its rows are alike the factors keep their
+    // converged pivots once, so the solves stream the right-hand side only.
+    tdma::LDLT<Real> LP_factor;
+    bool   p_factored = false;              // LP and LP_factor belong to the current momentum diagonal [-]
+
+    // Lagged momentum coefficients: the matrix and its factorization are kept
+    // while the face mass fluxes and velocities stay close to those they were
+    // assembled from, and only the right-hand side is rebuilt
+    tdma::Factorization<Real> LU_factor;
+    bool   u_factored = false;              // LU_factor belongs to the current momentum matrix [-]
+    std::vector<double> F_frozen;           // Face mass fluxes of the kept matrix, face i between cells i - 1 and i [kg/(m2s)]
+    std::vector<double> F_check;            // Face mass fluxes of the current iterate [kg/(m2s)]
+    std::vector<double> u_frozen;           // Velocity of the kept matrix [m/s]
+
+    struct Scalar {
+        std::string name;
+        double diffusivity = 0.0;           // [m2/s]
+        double source = 0.0;                // [1/s]
+        double inlet_value = 0.0;
+        double outlet_value = 0.0;
+        bool   inlet_bc = 0;
+        bool   outlet_bc = 0;
+
+        std::vector<Real> phi;              // Field
+        std::vector<Real> phi_old;          // Previous time step field
+        std::vector<Real> d;                // Right-hand side, then solution
+    };
+
+    // Scalars with identical matrices (same diffusivity and BC types). The group
+    // matching the energy equation reuses its factorization.
+    struct ScalarGroup {
+        double diffusivity = 0.0;
+        bool   inlet_bc = 0;
+        bool   outlet_bc = 0;
+        bool   shares_energy = false;
+        std::vector<int> members;
+        std::vector<Real> a, b, c;
+    };
+
+    std::vector<Scalar> scalars;
+    std::vector<ScalarGroup> scalar_groups;
 
-                    const double phi_l = rho_l * u_l_star;          // [kg/(m2s)]
-                    const double phi_r = rho_l * u_r_star;          // [kg/(m2s)]
+    // Convergence metrics
+    double continuity_residual = 1.0;
+    double momentum_residual = 1.0;
+    double energy_residual = 1.0;
 
-                    const double mass_imbalance = (phi_r - phi_l);  // [kg/(m2s)]
+    double u_error_l = 1.0;
+    double p_error_l = 1.0;
+    int outer_l = 0;
+    int inner_l = 0;
 
-                    const double mass_flux = S_m[i] * dz;           // [kg/(m2s)]
+    long long total_outer_l = 0;            // Outer iterations over the whole run [-]
+    long long total_inner_l = 0;            // Inner iterations over the whole run [-]
+    long long residual_checks_l = 0;        // Continuity, momentum and energy residual evaluations [-]
+    long long discarded_inner_l = 0;        // Speculative corrections thrown away on convergence [-]
+    long long early_stops_l = 0;            // Inner solves the adaptive tolerance stopped above piso_inner_tol [-]
+    long long skipped_inner_l = 0;          // Inner iterations finishing them would have taken, estimated [-]
+    long long frozen_momentum_l = 0;        // Outer iterations reusing the momentum matrix [-]
+    long long unconverged_steps_l = 0;      // Budgeted steps ending above the outer tolerance [-]
+
+    // Derivative component k is seeded into the input parameter seeded[k]
+    explicit BasicSolver(const Input& in, const std::vector<double Input::*>& seeded = {});
+
+    // Starts over on the case `in`, as a newly constructed solver would. The
+    // fields are reassigned in place, so with the same cell count they keep
+    // their storage.
+    void reset(const Input& in, const std::vector<double Input::*>& seeded = {});
+
+    BasicSolver(const BasicSolver&) = delete;
+    BasicSolver& operator=(const BasicSolver&) = delete;
+
+    void step();
+    void begin_step();
+    bool outer_iteration_due() const;
+    void outer_iteration();
+    void end_step();
+
+    void save_old_fields(bool sample);
+    bool in_statistics_window() const;
+    void finish_statistics();
+
+    void momentum_predictor();
+    void assemble_momentum();
+    void assemble_momentum_rhs();
+    void face_mass_fluxes(std::vector<double>& F) const;
+    bool momentum_matrix_current();
+    void assemble_energy();
+    void solve_energy();
+    void assemble_scalar_rhs(Scalar& sc);
+    void solve_scalars();
+    void update_inner_tolerance();
+    void count_skipped_inner();
+    int  step_solves() const;
+    int  outer_solves() const;
+    void keep_best_iterate();
+    void finish_budgeted_step();
+    void pressure_velocity_coupling();
+    void speculative_pressure_velocity_coupling();
+    void assemble_pressure_correction();
+    void solve_pressure_correction(std::vector<Real>& x);
+    void correct_pressure();
+    void correct_velocity();
+    void compute_continuity_residual();
+    void compute_momentum_residual();
+
+    // Solves in place in d with the stored multipliers of t, rebuilt if the
+    // matrix changed, when the rows from `edge` to N - 1 - edge are alike.
+    // False, leaving d alone, otherwise.
+    static bool solve_constant(tdma::Toeplitz<Real>& t, bool constant, int edge,
+        const std::vector<Real>& a, const std::vector<Real>& b, const std::vector<Real>& c, std::vector<Real>& d) {
+        if constexpr (!std::is_same<Real, double>::value) return false;
+        else {
+            if (!constant) return false;
+            if (!t.matches(a, b, c)) t.build(a, b, c, edge);
+            t.solve(d);
+            return true;
+        }
+    }
 
-                    continuity_residual =
-                        std::max(continuity_residual,
-                            std::abs(mass_flux - mass_imbalance) / cont_ref);
+    double steady_residual(std::vector<double>& r, std::array<double, 3>& scale);
+    double step_change() const;
+    void sync_pressure_storage();
+    void set_time_step(double dt_new);
+    void set_tolerances(double outer, double inner, double inner_max);
+
+    // Calls row(i, S_m, S_h) for the interior cells segment by segment, so the
+    // source-free stretches run without touching any source data
+    template <typename Row>
+    void for_interior_cells(Row&& row) const {
+
+        // Per-cell additions (the adjoint's source gradients) take a plain loop
+        if (!S_m_added.empty()) {
+            for (const sources::Segment& seg : source_segments)
+                for (int i = seg.begin; i < seg.end; ++i) {
+                    if (seg.zone < 0) row(i, S_m_added[i], S_h_added[i]);
+                    else row(i, zones[seg.zone].mass(i) + S_m_added[i], zones[seg.zone].heat(i) + S_h_added[i]);
                 }
+            return;
+        }
+
+        for (const sources::Segment& seg : source_segments) {
 
-                inner_l++;
+            if (seg.zone < 0) {
+                for (int i = seg.begin; i < seg.end; ++i) row(i, Real(0.0), Real(0.0));
+                continue;
             }
 
-            // -------------------------------------------------------
-            // MOMENTUM RESIDUAL CALCULATION
-            // -------------------------------------------------------
+            const sources::BasicZone<Real>& zone = zones[seg.zone];
 
-            double U_ref = 0.0;
-			double F_ref = 0.0;
+            if (zone.profile.empty()) {
+                const Real S_m_zone = zone.S_m;
+                const Real S_h_zone = zone.S_h;
+                for (int i = seg.begin; i < seg.end; ++i) row(i, S_m_zone, S_h_zone);
+            }
+            else {
+                for (int i = seg.begin; i < seg.end; ++i) row(i, zone.mass(i), zone.heat(i));
+            }
+        }
+    }
+};
 
-            for (int i = 0; i < N; ++i) {
+using Solver = BasicSolver<double>;
 
-                U_ref = std::max(U_ref, std::abs(u_l[i]));
-            }
+template <typename Real>
+BasicSolver<Real>::BasicSolver(const Input& in, const std::vector<double Input::*>& seeded) {
+    reset(in, seeded);
+}
 
-            for (int i = 0; i < N; ++i) {
-                const double F_inertia = rho_l * U_ref * U_ref;
-                const double F_unsteady = rho_l * U_ref * dz / dt;
-                const double F_viscous = mu * U_ref / dz;
+template <typename Real>
+void BasicSolver<Real>::reset(const Input& in, const std::vector<double Input::*>& seeded) {
+
+    auto parameter = [&](double Input::* member) {
+        Real x = in.*member;
+        for (std::size_t q = 0; q < seeded.size(); ++q)
+            if (seeded[q] == member) dual::seed(x, static_cast<int>(q));
+        return x;
+    };
+
+    N = in.N;
+    L = in.L;
+    dz = L / N;
+    dt = in.dt_user;
+
+    tot_outer_l = in.piso_outer_iter;
+    tot_inner_l = in.piso_inner_iter;
+    outer_tol_l = in.piso_outer_tol;
+    inner_tol_l = in.piso_inner_tol;
+    rhie_chow_on_off_l = in.rhie_chow_on_off_l;
+    task_graph = in.task_graph && omp_get_num_procs() > 1;
+    speculative_inner = in.piso_speculative;
+
+    inner_check = ResidualSchedule();
+    outer_check = ResidualSchedule();
+    inner_check.every = std::max(in.piso_inner_check_every, 1);
+    inner_check.adaptive = in.piso_adaptive_check;
+    outer_check.every = std::max(in.piso_outer_check_every, 1);
+    outer_check.adaptive = in.piso_adaptive_check;
+
+    inner_tol_adaptive = in.piso_inner_tol_adaptive;
+    inner_tol_max = std::max(in.piso_inner_tol_max, inner_tol_l);
+    forcing_max = in.piso_forcing_max;
+    inner_tol_eff = inner_tol_l;
+    momentum_freeze_tol = in.momentum_freeze_tol;
+    step_budget = in.piso_step_budget;
+    step_time_budget = in.piso_step_time_budget;
+
+    rho_l = parameter(&Input::rho);
+    mu = parameter(&Input::mu);
+    k = parameter(&Input::k);
+    cp = parameter(&Input::cp);
+
+    u_inlet_value = parameter(&Input::u_inlet_value);
+    u_outlet_value = parameter(&Input::u_outlet_value);
+    u_inlet_bc = in.u_inlet_bc;
+    u_outlet_bc = in.u_outlet_bc;
+
+    T_inlet_value = parameter(&Input::T_inlet_value);
+    T_outlet_value = parameter(&Input::T_outlet_value);
+    T_inlet_bc = in.T_inlet_bc;
+    T_outlet_bc = in.T_outlet_bc;
+
+    p_inlet_value = parameter(&Input::p_inlet_value);
+    p_outlet_value = parameter(&Input::p_outlet_value);
+    p_inlet_bc = in.p_inlet_bc;
+    p_outlet_bc = in.p_outlet_bc;
+
+    statistics_on = in.statistics;
+    statistics_start = in.statistics_start;
+    statistics_end = in.statistics_end;
+
+    if (statistics_on) {
+        u_stats.resize(N);
+        p_stats.resize(N);
+        T_stats.resize(N);
+    }
 
-                F_ref = std::max({ F_inertia, F_unsteady, F_viscous, 1e-30 });
+    u_l.assign(N, in.u_initial);
+    T_l.assign(N, in.T_initial);
+    p_l.assign(N, in.p_initial);
 
-            }
+    u_l_old = u_l;
+    T_l_old = T_l;
+    p_l_old = p_l;
 
-            momentum_residual = 0.0;
+    p_prime_l.assign(N, 0.0);
+    p_prime_spec_l.assign(N, 0.0);
+    p_storage_l.assign(N + 2, 0.0);
+    p_padded_l = &p_storage_l[1];
 
-            for (int i = 1; i < N - 1; ++i) {
+    // p_storage_l initialization
+    for (int i = 0; i < N; ++i)
+        p_storage_l[i + 1] = p_l[i];
 
-                const double avgInvbLU_L = 0.5 * (1.0 / bLU[i - 1] + 1.0 / bLU[i]);     // [m2s/kg]
-                const double avgInvbLU_R = 0.5 * (1.0 / bLU[i + 1] + 1.0 / bLU[i]);     // [m2s/kg]
+    p_storage_l[0] = p_l[0];
+    p_storage_l[N + 1] = p_l[N - 1];
 
-                const double rc_l = -avgInvbLU_L / 4.0 *
-                    (p_padded_l[i - 2] - 3.0 * p_padded_l[i - 1] + 3.0 * p_padded_l[i] - p_padded_l[i + 1]);    // [m/s]
-                const double rc_r = -avgInvbLU_R / 4.0 *
-                    (p_padded_l[i - 1] - 3.0 * p_padded_l[i] + 3.0 * p_padded_l[i + 1] - p_padded_l[i + 2]);    // [m/s]
+    u_prev.assign(N, 0.0);
+    p_prev.assign(N, 0.0);
+    T_prev.assign(N, 0.0);
+
+    // Run state of a previous case. The factorizations kept are marked stale;
+    // the energy matrix cache checks its coefficients itself.
+    time_total = 0.0;
+    signals.drivers.clear();
+    zones.clear();
+    S_m_added.clear();
+    S_h_added.clear();
+
+    check_outer = true;
+    forcing_l = 0.0;
+    outer_residual_last = 0.0;
+    outer_residual_fresh = true;
+    solve_time_l = 0.0;
+    budgeted_l = false;
+    step_solves_l = 0;
+    step_start_l = 0.0;
+    budget_l = 0;
+    inner_cap_l = 0;
+    step_converged = true;
+    best_residual_l = 0.0;
+    best_ahead_l = false;
+
+    p_factored = false;
+    u_factored = false;
+
+    continuity_residual = 1.0;
+    momentum_residual = 1.0;
+    energy_residual = 1.0;
+    u_error_l = 1.0;
+    p_error_l = 1.0;
+    outer_l = 0;
+    inner_l = 0;
+
+    total_outer_l = 0;
+    total_inner_l = 0;
+    residual_checks_l = 0;
+    discarded_inner_l = 0;
+    early_stops_l = 0;
+    skipped_inner_l = 0;
+    inner_rate_l = 0.0;
+    frozen_momentum_l = 0;
+    unconverged_steps_l = 0;
+
+    define_source_zones(in, N, dz, parameter(&Input::S_m_cell), parameter(&Input::S_h_cell), zones, signals);
+    source_segments = sources::segments(zones, 1, N - 1);
+
+    drive_boundary_values(in, *this, signals);
+
+    aLU.assign(N, 0.0);
+    bLU.assign(N, rho_l * dz / dt + 2 * mu / dz);
+    cLU.assign(N, 0.0);
+    dLU.assign(N, 0.0);
+
+    LP.assign(N, 0.0);
+    dLP.assign(N, 0.0);
+
+    aLT.assign(N, 0.0);
+    bLT.assign(N, 0.0);
+    cLT.assign(N, 0.0);
+    dLT.assign(N, 0.0);
+
+    u_face_l.assign(N + 1, 0.0);
+
+    const double energy_diffusivity = dual::value(k / (rho_l * cp));
+
+    // Scalars and groups of a previous case are reused in order
+    scalars.resize(in.scalars.size());
+    std::size_t groups = 0;
+
+    for (std::size_t s = 0; s < in.scalars.size(); ++s) {
+
+        const ScalarInput& si = in.scalars[s];
+
+        Scalar& sc = scalars[s];
+        sc.name = si.name;
+        sc.diffusivity = si.diffusivity;
+        sc.source = si.source;
+        sc.inlet_value = si.inlet_value;
+        sc.outlet_value = si.outlet_value;
+        sc.inlet_bc = si.inlet_bc;
+        sc.outlet_bc = si.outlet_bc;
+        sc.phi.assign(N, si.initial);
+        sc.phi_old = sc.phi;
+        sc.d.assign(N, 0.0);
+
+        auto same = [](double x, double y) { return std::abs(x - y) <= 1e-12 * std::max(std::abs(x), std::abs(y)); };
+
+        auto group = std::find_if(scalar_groups.begin(), scalar_groups.begin() + groups, [&](const ScalarGroup& g) {
+            return same(g.diffusivity, sc.diffusivity) && g.inlet_bc == sc.inlet_bc && g.outlet_bc == sc.outlet_bc;
+        });
+
+        if (group == scalar_groups.begin() + groups) {
+
+            if (groups == scalar_groups.size()) scalar_groups.emplace_back();
+
+            ScalarGroup& g = scalar_groups[groups];
+            g.diffusivity = sc.diffusivity;
+            g.inlet_bc = sc.inlet_bc;
+            g.outlet_bc = sc.outlet_bc;
+            g.shares_energy = same(g.diffusivity, energy_diffusivity) && g.inlet_bc == T_inlet_bc && g.outlet_bc == T_outlet_bc;
+            g.a.assign(N, 0.0);
+            g.b.assign(N, 0.0);
+            g.c.assign(N, 0.0);
+            g.members.clear();
+
+            group = scalar_groups.begin() + groups++;
+        }
 
-                const double D_l = mu / dz;
-                const double D_r = mu / dz;
+        group->members.push_back(static_cast<int>(s));
+    }
 
-                const double u_l_face =
-                    0.5 * (u_l[i - 1] + u_l[i]) + rc_l * rhie_chow_on_off_l;
-                const double u_r_face =
-                    0.5 * (u_l[i] + u_l[i + 1]) + rc_r * rhie_chow_on_off_l;
+    scalar_groups.resize(groups);
+}
 
-                const double F_l = rho_l * u_l_face;
-                const double F_r = rho_l * u_r_face;
+// Advances the fields by one time step
+template <typename Real>
+void BasicSolver<Real>::step() {
 
-                const double accum =
-                    rho_l * dz / dt * (u_l[i] - u_l_old[i]);
+    begin_step();
+    while (outer_iteration_due()) outer_iteration();
+    end_step();
+}
 
-                const double conv =
-                    F_r * u_r_face - F_l * u_l_face;
+// Moves to the next time level and resets the iteration state of the step.
+// With begin_step, outer_iteration and end_step a caller can run a step one
+// outer iteration at a time.
+template <typename Real>
+void BasicSolver<Real>::begin_step() {
 
-                const double diff =
-                    D_r * (u_l[i + 1] - u_l[i])
-                    - D_l * (u_l[i] - u_l[i - 1]);
+    // The fields entering the step belong to the current time level
+    const bool sample = statistics_on && in_statistics_window();
 
-                const double press =
-                    0.5 * (p_l[i + 1] - p_l[i - 1]);
+    // Boundary values and sources are taken at the new time level
+    time_total += dt;
+    signals.apply(time_total);
 
-                const double R =
-                    accum + conv - diff + press;
+    save_old_fields(sample);
 
-                momentum_residual =
-                    std::max(momentum_residual, std::abs(R) / F_ref);
-            }
+    for (Scalar& sc : scalars) sc.phi_old = sc.phi;
 
-            // -------------------------------
-            // TEMPERATURE RESIDUAL
-            // -------------------------------
-            energy_residual = 0.0;
+    u_error_l = 1.0;
+    outer_l = 0;
 
-            for (int i = 0; i < N; ++i) {
+    momentum_residual = 1.0;
+    energy_residual = 1.0;
 
-                energy_residual = std::max(
-                    energy_residual,
-                    std::abs(T_l[i] - T_prev[i])
-                );
-            }
+    outer_check.reset();
 
-            outer_l++;
-        }
+    forcing_l = forcing_max;
+    outer_residual_last = 0.0;
+    outer_residual_fresh = true;
 
-        // ===============================================================
-        // OUTPUT
-        // ===============================================================
+    budgeted_l = step_budget > 0 || step_time_budget > 0.0;
+    step_solves_l = budgeted_l ? step_solves() : 0;
+    step_start_l = budgeted_l ? omp_get_wtime() : 0.0;
 
-        if (n % print_every == 0) {
-            for (int i = 0; i < N; ++i) {
+    budget_l = step_solves_l;
+    inner_cap_l = tot_inner_l;
+    best_residual_l = std::numeric_limits<double>::infinity();
+    best_ahead_l = false;
+}
 
-                v_out << u_l[i] << ", ";
-                p_out << p_l[i] << ", ";
-                T_out << T_l[i] << ", ";
-            }
+// Whether the step takes another outer iteration: iterations and budget left,
+// residuals above the tolerance. An outer iteration takes its fixed solves and
+// at least one pressure correction.
+template <typename Real>
+bool BasicSolver<Real>::outer_iteration_due() const {
+
+    if (budgeted_l && budget_l < outer_solves() + 1) return false;
+
+    return outer_l < tot_outer_l && (momentum_residual > outer_tol_l || energy_residual > outer_tol_l);
+}
+
+// One outer iteration. The phases form a small task graph:
+//
+//   momentum predictor -> energy assembly -> +-> energy solve + energy residual
+//                                            +-> pressure-velocity coupling -> momentum residual
+//
+// The energy equation only needs the predicted velocity and the pressure the
+// matrix was assembled with, so its solve runs concurrently with the inner
+// PISO loop and the two residuals never wait on each other.
+template <typename Real>
+void BasicSolver<Real>::outer_iteration() {
+
+    // Under a budget the iteration gets half of what is left after its fixed
+    // solves for its inner iterations, so early iterations stop short and
+    // later ones, closer to convergence, inherit what the early ones did not
+    // use
+    if (budgeted_l) {
+        budget_l -= outer_solves();
+        inner_cap_l = std::min(tot_inner_l, std::max(1, (budget_l + 1) / 2));
+    }
+
+    check_outer = outer_check.due(outer_l + 1);
+
+    if (inner_tol_adaptive) update_inner_tolerance();
 
-            v_out << "\n";
-            p_out << "\n";
-            T_out << "\n";
+    momentum_predictor();
+    assemble_energy();
+
+    #pragma omp parallel sections num_threads(2) if (task_graph)
+    {
+        #pragma omp section
+        solve_energy();
+
+        #pragma omp section
+        {
+            pressure_velocity_coupling();
+            if (check_outer) compute_momentum_residual();
         }
     }
 
-    v_out.flush();
-    p_out.flush();
-    T_out.flush();
+    outer_l++;
+    total_inner_l += inner_l;
 
-    v_out.close();
-    p_out.close();
-    T_out.close();
+    if (check_outer) {
+        outer_check.update(outer_l, std::max(momentum_residual, energy_residual), outer_tol_l);
+        residual_checks_l += 2;
+        outer_residual_fresh = true;
+    }
 
-    double end = omp_get_wtime();
-    printf("Execution time: %.6f s\n", end - start);
+    if (budgeted_l) {
+        budget_l -= inner_l;
+        keep_best_iterate();
+    }
+}
 
-    return 0;
-}
\ No newline at end of file
+template <typename Real>
+void BasicSolver<Real>::end_step() {
+
+    total_outer_l += outer_l;
+
+    if (budgeted_l) finish_budgeted_step();
+}
+
+// Linear solves the step may take: the solve budget, or the time budget over
+// the average solve time of the past steps, whichever is smaller. A step
+// always gets one full outer iteration, which also times the first step.
+template <typename Real>
+int BasicSolver<Real>::step_solves() const {
+
+    double solves = step_budget > 0 ? step_budget : std::numeric_limits<int>::max();
+
+    if (step_time_budget > 0.0 && solve_time_l > 0.0)
+        solves = std::min(solves, step_time_budget / solve_time_l);
+    else if (step_time_budget > 0.0)
+        solves = outer_solves() + 1;
+
+    return std::max(static_cast<int>(solves), outer_solves() + 1);
+}
+
+// Linear solves of an outer iteration besides its pressure corrections: the
+// momentum and energy solves, and one per passive scalar group with a matrix
+// of its own. The group sharing the energy matrix rides on the energy solve.
+template <typename Real>
+int BasicSolver<Real>::outer_solves() const {
+
+    int solves = 2;
+    for (const ScalarGroup& group : scalar_groups)
+        if (!group.shares_energy) solves++;
+
+    return solves;
+}
+
+// Keeps a copy of the iterate if its outer residual is the lowest of the step.
+// Iterates whose residuals were not evaluated leave the copy alone.
+template <typename Real>
+void BasicSolver<Real>::keep_best_iterate() {
+
+    if (!check_outer) {
+        best_ahead_l = false;
+        return;
+    }
+
+    const double r = std::max(momentum_residual, energy_residual);
+
+    best_ahead_l = r >= best_residual_l;
+    if (best_ahead_l) return;
+
+    best_residual_l = r;
+    best_l.u = u_l;
+    best_l.p = p_l;
+    best_l.T = T_l;
+    best_l.bLU = bLU;
+
+    best_l.phi.resize(scalars.size());
+    for (std::size_t s = 0; s < scalars.size(); ++s) best_l.phi[s] = scalars[s].phi;
+
+    best_l.continuity_residual = continuity_residual;
+    best_l.momentum_residual = momentum_residual;
+    best_l.energy_residual = energy_residual;
+}
+
+// A budgeted step ending above the outer tolerance is flagged as not
+// converged and returns the iterate of the lowest residual, if the last one is
+// known to be worse. The time per solve is averaged over the steps for the
+// time budget.
+template <typename Real>
+void BasicSolver<Real>::finish_budgeted_step() {
+
+    step_converged = momentum_residual <= outer_tol_l && energy_residual <= outer_tol_l;
+
+    if (!step_converged) {
+
+        unconverged_steps_l++;
+
+        if (best_ahead_l) {
+            u_l = best_l.u;
+            p_l = best_l.p;
+            T_l = best_l.T;
+            bLU = best_l.bLU;
+            sync_pressure_storage();
+
+            for (std::size_t s = 0; s < scalars.size(); ++s) scalars[s].phi = best_l.phi[s];
+
+            continuity_residual = best_l.continuity_residual;
+            momentum_residual = best_l.momentum_residual;
+            energy_residual = best_l.energy_residual;
+        }
+    }
+
+    const int used = step_solves_l - budget_l;
+
+    if (step_time_budget > 0.0 && used > 0) {
+        const double t = (omp_get_wtime() - step_start_l) / used;
+        solve_time_l = solve_time_l > 0.0 ? 0.8 * solve_time_l + 0.2 * t : t;
+    }
+}
+
+// Saves u, p and T as the previous time level. With `sample` the same pass
+// adds them to the running statistics, so statistics cost no pass of their own.
+template <typename Real>
+void BasicSolver<Real>::save_old_fields(bool sample) {
+
+    if (!sample) {
+        u_l_old = u_l;
+        T_l_old = T_l;
+        p_l_old = p_l;
+        return;
+    }
+
+    u_stats.next();
+    p_stats.next();
+    T_stats.next();
+
+    for (int i = 0; i < N; ++i) {
+
+        u_l_old[i] = u_l[i];
+        T_l_old[i] = T_l[i];
+        p_l_old[i] = p_l[i];
+
+        u_stats.add(i, dual::value(u_l[i]));
+        p_stats.add(i, dual::value(p_l[i]));
+        T_stats.add(i, dual::value(T_l[i]));
+    }
+}
+
+template <typename Real>
+bool BasicSolver<Real>::in_statistics_window() const {
+    return time_total >= statistics_start - 0.5 * dt && time_total <= statistics_end + 0.5 * dt;
+}
+
+// Samples the final fields, which no later step saves
+template <typename Real>
+void BasicSolver<Real>::finish_statistics() {
+
+    if (!statistics_on || !in_statistics_window()) return;
+
+    u_stats.next();
+    p_stats.next();
+    T_stats.next();
+
+    for (int i = 0; i < N; ++i) {
+        u_stats.add(i, dual::value(u_l[i]));
+        p_stats.add(i, dual::value(p_l[i]));
+        T_stats.add(i, dual::value(T_l[i]));
+    }
+}
+
+// Inexact inner solves: the continuity tolerance follows the outer (momentum)
+// residual through an EisenstatWalker forcing term (choice 2, gamma = 0.9,
+// alpha = 2, with the usual safeguard against dropping too fast), bounded
+// below by piso_inner_tol and above by piso_inner_tol_max. Early outer
+// iterations stop after a few corrections, the last ones converge fully. The
+// last permitted outer iteration always uses the full tolerance, since no
+// later iteration could make up for a loose inner solve. After an outer
+// iteration that skipped its residual check the momentum residual is the one
+// already used, so the forcing term and the tolerance are kept as they are.
+template <typename Real>
+void BasicSolver<Real>::update_inner_tolerance() {
+
+    if (outer_residual_fresh) {
+
+        const double r = momentum_residual;
+
+        if (outer_l > 0 && outer_residual_last > 0.0) {
+
+            double eta = 0.9 * std::pow(r / outer_residual_last, 2);
+            const double safeguard = 0.9 * forcing_l * forcing_l;
+
+            if (safeguard > 0.1) eta = std::max(eta, safeguard);
+
+            forcing_l = std::min(eta, forcing_max);
+        }
+
+        outer_residual_last = r;
+        inner_tol_eff = std::clamp(forcing_l * r, inner_tol_l, inner_tol_max);
+        outer_residual_fresh = false;
+    }
+
+    if (outer_l == tot_outer_l - 1) inner_tol_eff = inner_tol_l;
+}
+
+// Counts the inner solves the adaptive tolerance stopped above piso_inner_tol,
+// and the inner iterations finishing them to piso_inner_tol would have taken,
+// up to the inner cap. The latter is extrapolated at the contraction rate of
+// the continuity residual between the first and last checks of the solve, or
+// the latest one measured if it had a single check. It is the work skipped on
+// this run's iterates; a run with the fixed tolerance follows other iterates,
+// so the difference of the two runs' totals is not the same number.
+template <typename Real>
+void BasicSolver<Real>::count_skipped_inner() {
+
+    const ResidualSchedule& c = inner_check;
+
+    if (c.last_iter > c.first_iter && c.last_residual < c.first_residual)
+        inner_rate_l = std::pow(c.last_residual / c.first_residual, 1.0 / (c.last_iter - c.first_iter));
+
+    // Only a stop at the loose tolerance leaves work for the fixed one
+    if (c.last_iter == 0 || c.last_residual > inner_tol_eff || c.last_residual <= inner_tol_l) return;
+
+    early_stops_l++;
+
+    const double more = inner_rate_l > 0.0 && inner_rate_l < 1.0
+        ? std::ceil(std::log(inner_tol_l / c.last_residual) / std::log(inner_rate_l))
+        : std::numeric_limits<double>::infinity();
+
+    skipped_inner_l += static_cast<long long>(std::min(more, static_cast<double>(inner_cap_l - inner_l)));
+}
+
+// ===========================================================
+// MOMENTUM PREDICTOR
+// ===========================================================
+
+template <typename Real>
+void BasicSolver<Real>::momentum_predictor() {
+
+    if (momentum_freeze_tol <= 0.0) {
+        assemble_momentum();
+        u_l = tdma::solve(aLU, bLU, cLU, dLU);
+        return;
+    }
+
+    if (momentum_matrix_current()) {
+        assemble_momentum_rhs();
+        frozen_momentum_l++;
+    }
+    else {
+        assemble_momentum();
+        LU_factor = tdma::factor(aLU, bLU, cLU);
+        u_factored = true;
+
+        face_mass_fluxes(F_frozen);
+        u_frozen.resize(N);
+        for (int i = 0; i < N; ++i) u_frozen[i] = dual::value(u_l[i]);
+    }
+
+    std::vector<std::vector<Real>*> rhs = { &dLU };
+    tdma::solve_many(LU_factor, rhs);
+    u_l.swap(dLU);
+}
+
+// Face mass fluxes of the current iterate as the momentum assembly forms
+// them, face i between cells i - 1 and i, with the current momentum diagonal
+template <typename Real>
+void BasicSolver<Real>::face_mass_fluxes(std::vector<double>& F) const {
+
+    auto v = [](const Real& x) { return dual::value(x); };
+
+    F.assign(N + 1, 0.0);
+
+    for (int i = 1; i < N; ++i) {
+
+        const double avgInvbLU = 0.5 * (1.0 / v(bLU[i - 1]) + 1.0 / v(bLU[i]));     // [m2s/kg]
+
+        const double rc = -avgInvbLU / 4.0 *
+            (v(p_padded_l[i - 2]) - 3.0 * v(p_padded_l[i - 1]) + 3.0 * v(p_padded_l[i]) - v(p_padded_l[i + 1]));  // [m/s]
+
+        F[i] = v(rho_l) * (0.5 * (v(u_l[i - 1]) + v(u_l[i])) + rhie_chow_on_off_l * rc);     // [kg/(m2s)]
+    }
+}
+
+// Whether the kept momentum matrix still stands for the current iterate: the
+// face mass fluxes and the velocity (convection and Forchheimer terms) within
+// momentum_freeze_tol of those it was assembled from, relative to their
+// largest magnitudes
+template <typename Real>
+bool BasicSolver<Real>::momentum_matrix_current() {
+
+    if (!u_factored) return false;
+
+    std::vector<double>& F = F_check;
+    face_mass_fluxes(F);
+
+    double dF = 0.0, F_max = 0.0, du = 0.0, u_max = 0.0;
+
+    for (int i = 1; i < N; ++i) {
+        dF = std::max(dF, std::abs(F[i] - F_frozen[i]));
+        F_max = std::max(F_max, std::abs(F_frozen[i]));
+    }
+
+    for (int i = 0; i < N; ++i) {
+        du = std::max(du, std::abs(dual::value(u_l[i]) - u_frozen[i]));
+        u_max = std::max(u_max, std::abs(u_frozen[i]));
+    }
+
+    return dF <= momentum_freeze_tol * F_max && du <= momentum_freeze_tol * u_max;
+}
+
+template <typename Real>
+void BasicSolver<Real>::assemble_momentum() {
+
+    discretization::momentum_matrix(*this);
+
+    assemble_momentum_rhs();
+
+    // New momentum matrix and diagonal, new pressure-correction matrix
+    u_factored = false;
+    p_factored = false;
+}
+
+// Right-hand side of the momentum equation, the only part depending on the
+// pressure and the old time level
+template <typename Real>
+void BasicSolver<Real>::assemble_momentum_rhs() {
+
+    discretization::momentum_rhs(*this);
+}
+
+// ===============================================================
+// TEMPERATURE SOLVER
+// ===============================================================
+
+template <typename Real>
+void BasicSolver<Real>::assemble_energy() {
+
+    T_uniform = discretization::energy_system(*this);
+}
+
+template <typename Real>
+void BasicSolver<Real>::solve_energy() {
+
+    if (check_outer) T_prev = T_l;
+
+    if (!scalars.empty()) solve_scalars();
+    else if (solve_constant(T_toeplitz, T_uniform, 1, aLT, bLT, cLT, dLT)) T_l.swap(dLT);
+    else T_l = tdma::solve(aLT, bLT, cLT, dLT);
+
+    if (!check_outer) return;
+
+    // -------------------------------
+    // TEMPERATURE RESIDUAL
+    // -------------------------------
+    energy_residual = 0.0;
+
+    for (int i = 0; i < N; ++i) {
+
+        energy_residual = std::max(
+            energy_residual,
+            std::abs(dual::value(T_l[i]) - dual::value(T_prev[i]))
+        );
+    }
+}
+
+// ===============================================================
+// PASSIVE SCALARS
+// ===============================================================
+
+// Same discretization as the energy equation, with the face velocities the
+// energy assembly stored and a uniform volumetric production rate
+template <typename Real>
+void BasicSolver<Real>::assemble_scalar_rhs(Scalar& sc) {
+
+    for_interior_cells([&](int i, const Real& S_m_i, const Real&) {
+
+        sc.d[i] = discretization::energy_source(*this, sc.phi_old[i], S_m_i, sc.source, dz);
+    });
+
+    sc.d[0] = sc.inlet_bc == 0 ? sc.inlet_value : 0.0;
+    sc.d[N - 1] = sc.outlet_bc == 0 ? sc.outlet_value : 0.0;
+}
+
+// Scalars are solved group by group: one factorization per distinct matrix
+// and one multi-right-hand-side sweep for all its members, so the cost grows
+// with the number of distinct matrices rather than the number of scalars. The
+// group sharing the energy matrix is solved together with the temperature;
+// the other groups are independent and run in parallel.
+template <typename Real>
+void BasicSolver<Real>::solve_scalars() {
+
+    for (Scalar& sc : scalars) assemble_scalar_rhs(sc);
+
+    bool energy_shared = false;
+    for (const ScalarGroup& group : scalar_groups) energy_shared |= group.shares_energy;
+
+    if (!energy_shared) T_l = tdma::solve(aLT, bLT, cLT, dLT);
+
+    const int groups = static_cast<int>(scalar_groups.size());
+
+    #pragma omp parallel for schedule(dynamic) if (task_graph && groups > 1)
+    for (int g = 0; g < groups; ++g) {
+
+        ScalarGroup& group = scalar_groups[g];
+        std::vector<std::vector<Real>*> rhs;
+        tdma::Factorization<Real> f;
+
+        if (group.shares_energy) {
+
+            f = tdma::factor(aLT, bLT, cLT);
+            rhs.push_back(&dLT);
+        }
+        else {
+
+            const double D = group.diffusivity / dz;
+
+            for (int i = 1; i < N - 1; ++i) {
+
+                const auto c = discretization::upwind<Real>(u_face_l[i], u_face_l[i + 1], D, D);
+
+                group.a[i] = c.a;
+                group.c[i] = c.c;
+                group.b[i] = c.outflow + D + D + dz / dt;
+            }
+
+            group.a[0] = 0.0;
+            group.b[0] = 1.0;
+            group.c[0] = group.inlet_bc == 0 ? 0.0 : -1.0;
+
+            group.a[N - 1] = group.outlet_bc == 0 ? 0.0 : -1.0;
+            group.b[N - 1] = 1.0;
+            group.c[N - 1] = 0.0;
+
+            f = tdma::factor(group.a, group.b, group.c);
+        }
+
+        for (int m : group.members) rhs.push_back(&scalars[m].d);
+
+        tdma::solve_many(f, rhs);
+
+        for (int m : group.members) scalars[m].phi.swap(scalars[m].d);
+        if (group.shares_energy) T_l.swap(dLT);
+    }
+}
+
+// ===============================================================
+// PRESSURE-VELOCITY COUPLING
+// ===============================================================
+
+template <typename Real>
+void BasicSolver<Real>::pressure_velocity_coupling() {
+
+    p_error_l = 1.0;
+    inner_l = 0;
+
+    continuity_residual = 1.0;
+
+    inner_check.reset();
+
+    if (speculative_inner) speculative_pressure_velocity_coupling();
+
+    else while (inner_l < inner_cap_l && continuity_residual > inner_tol_eff) {
+
+        assemble_pressure_correction();
+        solve_pressure_correction(p_prime_l);
+
+        correct_pressure();
+        correct_velocity();
+
+        inner_l++;
+
+        if (inner_check.due(inner_l)) {
+            compute_continuity_residual();
+            inner_check.update(inner_l, continuity_residual, inner_tol_eff);
+        }
+    }
+
+    if (inner_tol_adaptive) count_skipped_inner();
+}
+
+// Same iterations as the plain inner loop, but the continuity residual of
+// iteration k and the pressure-correction assembly and solve of iteration k+1
+// run concurrently: both only read u_l, p_l and bLU, and the speculative
+// correction lands in its own buffer. If iteration k turns out to be converged
+// the speculative correction is simply dropped, so no state has to be rolled
+// back and the fields are identical to the non-speculative loop.
+template <typename Real>
+void BasicSolver<Real>::speculative_pressure_velocity_coupling() {
+
+    if (inner_cap_l <= 0) return;
+
+    assemble_pressure_correction();
+    solve_pressure_correction(p_prime_l);
+
+    while (true) {
+
+        correct_pressure();
+        correct_velocity();
+
+        inner_l++;
+
+        // The last iteration has no successor to overlap, but its residual is
+        // evaluated as in the plain loop
+        if (inner_l >= inner_cap_l) {
+            if (inner_check.due(inner_l)) {
+                compute_continuity_residual();
+                inner_check.update(inner_l, continuity_residual, inner_tol_eff);
+            }
+            break;
+        }
+
+        // Nothing to overlap when the residual is not due in this iteration
+        if (!inner_check.due(inner_l)) {
+            assemble_pressure_correction();
+            solve_pressure_correction(p_prime_l);
+            continue;
+        }
+
+        #pragma omp parallel sections num_threads(2) if (task_graph)
+        {
+            #pragma omp section
+            compute_continuity_residual();
+
+            #pragma omp section
+            {
+                assemble_pressure_correction();
+                solve_pressure_correction(p_prime_spec_l);
+            }
+        }
+
+        inner_check.update(inner_l, continuity_residual, inner_tol_eff);
+
+        if (continuity_residual <= inner_tol_eff) {
+            discarded_inner_l++;
+            break;
+        }
+
+        std::swap(p_prime_l, p_prime_spec_l);
+    }
+}
+
+// -------------------------------------------------------
+// CONTINUITY SATISFACTOR: assemble pressure correction
+// -------------------------------------------------------
+
+template <typename Real>
+void BasicSolver<Real>::assemble_pressure_correction() {
+
+    discretization::pressure_correction_system(*this, !p_factored);
+
+    if (p_factored) return;
+
+    LP_factor = tdma::factor(LP);
+    p_factored = true;
+}
+
+// Solution of the assembled pressure correction into x, in place in dLP
+template <typename Real>
+void BasicSolver<Real>::solve_pressure_correction(std::vector<Real>& x) {
+
+    tdma::solve(LP_factor, dLP);
+    x.swap(dLP);
+}
+
+// -------------------------------------------------------
+// PRESSURE CORRECTOR
+// -------------------------------------------------------
+
+template <typename Real>
+void BasicSolver<Real>::correct_pressure() {
+
+    p_error_l = 0.0;
+
+    for (int i = 0; i < N; ++i) {
+
+        p_prev[i] = p_l[i];
+        p_l[i] += p_prime_l[i];
+
+        p_storage_l[i + 1] = p_l[i];
+        p_error_l = std::max(p_error_l, std::fabs(dual::value(p_l[i]) - dual::value(p_prev[i])));
+    }
+
+    discretization::pressure_boundaries(*this);
+}
+
+// -------------------------------------------------------
+// VELOCITY CORRECTOR
+// -------------------------------------------------------
+
+template <typename Real>
+void BasicSolver<Real>::correct_velocity() {
+
+    u_error_l = 0.0;
+
+    for (int i = 1; i < N - 1; ++i) {
+        u_prev[i] = u_l[i];
+        u_l[i] -= discretization::velocity_correction(*this, i);
+        u_error_l = std::max(u_error_l, std::fabs(dual::value(u_l[i]) - dual::value(u_prev[i])));
+    }
+}
+
+// -------------------------------------------------------
+// CONTINUITY RESIDUAL CALCULATION
+// -------------------------------------------------------
+
+// Residuals only steer the iterations, so they are evaluated on the values
+// of the fields
+template <typename Real>
+void BasicSolver<Real>::compute_continuity_residual() {
+
+    residual_checks_l++;
+
+    continuity_residual = discretization::continuity_residual(*this);
+}
+
+// -------------------------------------------------------
+// MOMENTUM RESIDUAL CALCULATION
+// -------------------------------------------------------
+
+template <typename Real>
+void BasicSolver<Real>::compute_momentum_residual() {
+
+    momentum_residual = discretization::momentum_residual(*this);
+}
+
+// -------------------------------------------------------
+// STEADY RESIDUAL
+// -------------------------------------------------------
+
+// Largest change of u, p and T over the last time step, each relative to the
+// field's magnitude
+template <typename Real>
+double BasicSolver<Real>::step_change() const {
+
+    auto change = [](const std::vector<Real>& x, const std::vector<Real>& x_old) {
+        double c = 0.0, size = 1e-30;
+        for (std::size_t i = 0; i < x.size(); ++i) {
+            c = std::max(c, std::abs(dual::value(x[i]) - dual::value(x_old[i])));
+            size = std::max(size, std::abs(dual::value(x[i])));
+        }
+        return c / size;
+    };
+
+    return std::max({ change(u_l, u_l_old), change(p_l, p_l_old), change(T_l, T_l_old) });
+}
+
+// Padded pressure of fields set from outside the PISO loop, with the ghost
+// values correct_pressure leaves behind
+template <typename Real>
+void BasicSolver<Real>::sync_pressure_storage() {
+
+    for (int i = 0; i < N; ++i) p_storage_l[i + 1] = p_l[i];
+    if (p_inlet_bc == 1) p_storage_l[0] = p_storage_l[1];
+    p_storage_l[N + 1] = p_outlet_bc == 0 ? p_outlet_value : p_storage_l[N];
+}
+
+// Time step of the following steps. The stored momentum and pressure-correction
+// factorizations hold the old one and are rebuilt.
+template <typename Real>
+void BasicSolver<Real>::set_time_step(double dt_new) {
+
+    if (dt_new == dt) return;
+
+    dt = dt_new;
+    u_factored = false;
+    p_factored = false;
+}
+
+// Outer and inner tolerances of the following steps, and the loosest
+// adaptive inner tolerance, as the constructor sets them from the input
+template <typename Real>
+void BasicSolver<Real>::set_tolerances(double outer, double inner, double inner_max) {
+
+    outer_tol_l = outer;
+    inner_tol_l = inner;
+    inner_tol_max = std::max(inner_max, inner);
+    inner_tol_eff = inner;
+}
+
+// Residuals of the discrete equations at the current fields with the time
+// derivatives dropped (old fields set to the current ones), so the steady
+// states of the time marching are exactly its zeros. The rows are stacked as
+// momentum, continuity and energy, N each, the boundary rows scaled like the
+// adjacent interior ones. `scale` receives the reference magnitude of each
+// block, as used by the PISO residuals, and the largest normalized residual
+// is returned. The references include the time terms, so the momentum and
+// energy parts measure the relative change one time step would bring.
+// Overwrites the old fields and the assembled coefficients.
+template <typename Real>
+double BasicSolver<Real>::steady_residual(std::vector<double>& r, std::array<double, 3>& scale) {
+
+    u_l_old = u_l;
+    T_l_old = T_l;
+    p_l_old = p_l;
+
+    sync_pressure_storage();
+
+    // RhieChow of the second assembly uses the momentum diagonal of these fields
+    assemble_momentum();
+    assemble_momentum();
+    assemble_pressure_correction();
+    assemble_energy();
+
+    r.assign(3 * N, 0.0);
+
+    auto row = [](const std::vector<double>& a, const std::vector<double>& b, const std::vector<double>& c,
+        const std::vector<double>& d, const std::vector<double>& x, int i) {
+        const int n = static_cast<int>(x.size());
+        return (i > 0 ? a[i] * x[i - 1] : 0.0) + b[i] * x[i] + (i < n - 1 ? c[i] * x[i + 1] : 0.0) - d[i];
+    };
+
+    for (int i = 0; i < N; ++i) {
+        r[i] = row(aLU, bLU, cLU, dLU, u_l, i);
+        r[2 * N + i] = row(aLT, bLT, cLT, dLT, T_l, i);
+    }
+
+    for (int i = 1; i < N - 1; ++i) r[N + i] = dLP[i];
+
+    r[N] = LP.diag[1] * (p_inlet_bc == 0 ? p_l[0] - p_inlet_value : p_l[0] - p_l[1]);
+    r[2 * N - 1] = LP.diag[N - 2] * (p_outlet_bc == 0 ? p_l[N - 1] - p_outlet_value : p_l[N - 1] - p_l[N - 2]);
+
+    r[2 * N] *= bLT[1];
+    r[3 * N - 1] *= bLT[N - 2];
+
+    double U_ref = 0.0, T_ref = 0.0, bT_ref = 0.0, Sm_ref = 0.0;
+
+    for (int i = 0; i < N; ++i) {
+        U_ref = std::max(U_ref, std::abs(u_l[i]));
+        T_ref = std::max(T_ref, std::abs(T_l[i]));
+        bT_ref = std::max(bT_ref, std::abs(bLT[i]));
+    }
+
+    for (const sources::Zone& zone : zones)
+        for (int i = zone.begin; i < zone.end; ++i)
+            Sm_ref = std::max(Sm_ref, std::abs(zone.mass(i) * dz));
+
+    scale[0] = std::max({ rho_l * U_ref * U_ref, rho_l * U_ref * dz / dt, mu * U_ref / dz, 1e-30 });
+    scale[1] = std::max({ rho_l * U_ref, Sm_ref, 1e-30 });
+    scale[2] = std::max(bT_ref * T_ref, 1e-30);
+
+    double estimate = 0.0;
+
+    for (int b = 0; b < 3; ++b)
+        for (int i = 0; i < N; ++i)
+            estimate = std::max(estimate, std::abs(r[b * N + i]) / scale[b]);
+
+    return estimate;
+}
+
+#pragma endregion
+
+#pragma region axisymmetric
+
+// =======================================================================
+//                        AXISYMMETRIC (r, z) SOLVER
+// =======================================================================
+
+// Collocated PISO on an Nz x Nr grid covering 0 < z < L, 0 < r < R, with all
+// extensive quantities taken per radian: cell (i, j) has volume r_j dr dz,
+// axial faces of area r_j dr and radial faces of area r_(j -/+ 1/2) dz. The
+// rows are built from the pointwise kernels of namespace discretization, the
+// radial direction like the axial one, so the axial discretization is the 1D
+// one, including the first and last axial cells carrying the inlet/outlet
+// BCs. The axis is a symmetry line, the
+// wall is impermeable and adiabatic, with a no-slip or slip axial velocity.
+// The zones and their sources extend over the whole radius. Every five-point
+// system is solved by ADI line relaxation, each sweep being two batches of
+// independent tridiagonal solves (all z-lines, then all r-lines).
+struct Solver2D {
+
+    int    Nz = 0;                          // Number of axial cells [-]
+    int    Nr = 0;                          // Number of radial cells [-]
+    double L = 0.0;                         // Length of the domain [m]
+    double R = 0.0;                         // Radius of the domain [m]
+    double dz = 0.0;                        // Axial cell size [m]
+    double dr = 0.0;                        // Radial cell size [m]
+    double dt = 0.0;                        // Time step [s]
+
+    int    tot_outer_l = 0;                 // PISO outer iterations [-]
+    int    tot_inner_l = 0;                 // PISO inner iterations [-]
+    double outer_tol_l = 0.0;               // PISO outer tolerance [-]
+    double inner_tol_l = 0.0;               // PISO inner tolerance [-]
+    bool   rhie_chow_on_off_l = true;       // RhieChow interpolation on/off (1/0) [-]
+    bool   wall_no_slip = true;             // No-slip (1) or slip (0) wall for the axial velocity [-]
+
+    int    adi_sweeps = 0;                  // ADI sweeps per momentum and energy solve [-]
+    int    adi_pressure_sweeps = 0;         // Maximum ADI sweeps per pressure-correction solve [-]
+    double adi_pressure_tol = 0.0;          // Residual reduction of the pressure-correction solve [-]
+
+    bool   pressure_multigrid = true;       // Multigrid (1) or ADI (0) pressure-correction solver [-]
+    int    mg_pressure_cycles = 0;          // Maximum multigrid cycles per pressure-correction solve [-]
+    double mg_pressure_tol = 0.0;           // Residual reduction of the multigrid solve [-]
+
+    double rho_l = 0.0;                     // Density [kg/m3]
+    double mu = 0.0;                        // Dynamic viscosity [kg/(m s)]
+    double k = 0.0;                         // Thermal conductivity [W/(m K)]
+    double cp = 0.0;                        // Specific heat capacity at constant pressure [J/kgK]
+
+    double u_inlet_value = 0.0;             // Inlet velocity [m/s]
+    double u_outlet_value = 0.0;            // Outlet velocity [m/s]
+    bool   u_inlet_bc = 0;                  // Inlet velocity BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   u_outlet_bc = 0;                 // Outlet velocity BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    double T_inlet_value = 0.0;             // Inlet temperature [K]
+    double T_outlet_value = 0.0;            // Outlet temperature [K]
+    bool   T_inlet_bc = 0;                  // Inlet temperature BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   T_outlet_bc = 0;                 // Outlet temperature BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    double p_inlet_value = 0.0;             // Inlet pressure [Pa]
+    double p_outlet_value = 0.0;            // Outlet pressure [Pa]
+    bool   p_inlet_bc = 0;                  // Inlet pressure BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   p_outlet_bc = 0;                 // Outlet pressure BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    const double K = 1e-8;
+    const double CF = 1e-4;
+
+    double time_total = 0.0;                // Simulated time [s]
+    Signals signals;                        // Tabulated boundary values and source strengths
+
+    std::vector<double> r_c;                // Cell-centre radii [m]
+    std::vector<double> r_f;                // Face radii, face j between cells j - 1 and j [m]
+
+    // Fields, cell (i, j) at j * Nz + i
+    std::vector<double> u_l;                // Axial velocity [m/s]
+    std::vector<double> v_l;                // Radial velocity [m/s]
+    std::vector<double> p_l;                // Pressure [Pa]
+    std::vector<double> T_l;                // Temperature [K]
+
+    std::vector<double> u_l_old;            // Previous time step axial velocity [m/s]
+    std::vector<double> v_l_old;            // Previous time step radial velocity [m/s]
+    std::vector<double> T_l_old;            // Previous time step temperature [K]
+
+    std::vector<double> p_prime_l;          // Pressure correction [Pa]
+    std::vector<double> T_prev;             // Previous iteration temperature for convergence check [K]
+
+    std::vector<double> u_face_l;           // Axial face velocities, face i of row j at j * (Nz + 1) + i [m/s]
+    std::vector<double> v_face_l;           // Radial face velocities, face j of column i at j * Nz + i [m/s]
+
+    std::vector<sources::Zone> zones;               // Evaporation and condensation zones (axial cells)
+    std::vector<sources::Segment> source_segments;  // Interior axial cells split into source-free and zone segments
+
+    adi::Stencil mom_u, mom_v;              // Momentum systems, their diagonals also feed RhieChow
+    adi::Stencil pressure;                  // Pressure-correction system
+    adi::Stencil energy;                    // Energy system
+    adi::Workspace work;
+    multigrid::Hierarchy mg;                // Coarse pressure-correction operators
+
+    // Convergence metrics
+    double continuity_residual = 1.0;
+    double momentum_residual = 1.0;
+    double energy_residual = 1.0;
+
+    int outer_l = 0;
+    int inner_l = 0;
+
+    long long total_outer_l = 0;            // Outer iterations over the whole run [-]
+    long long total_inner_l = 0;            // Inner iterations over the whole run [-]
+    long long residual_checks_l = 0;        // Continuity, momentum and energy residual evaluations [-]
+    long long pressure_sweeps_l = 0;        // ADI sweeps spent on pressure corrections [-]
+    long long pressure_cycles_l = 0;        // Multigrid cycles spent on pressure corrections [-]
+
+    explicit Solver2D(const Input& in);
+
+    Solver2D(const Solver2D&) = delete;
+    Solver2D& operator=(const Solver2D&) = delete;
+
+    void step();
+
+    void update_face_velocities();
+    void momentum_predictor();
+    void solve_energy();
+    void pressure_velocity_coupling();
+    void assemble_pressure_correction();
+    void solve_pressure_correction();
+    void correct_pressure();
+    void correct_velocity();
+    void compute_continuity_residual();
+    void compute_momentum_residual();
+
+    int id(int i, int j) const { return j * Nz + i; }
+
+    // Pressure with the boundary cells mirrored into the ghost layers
+    double P(int i, int j) const {
+        return p_l[id(std::clamp(i, 0, Nz - 1), std::clamp(j, 0, Nr - 1))];
+    }
+
+    // Calls row(i, j, S_m, S_h) for the interior cells, radial row by radial
+    // row and segment by segment; the rows are shared among the OpenMP threads
+    template <typename Row>
+    void for_interior_cells(Row&& row) const {
+
+        #pragma omp parallel for schedule(static)
+        for (int j = 0; j < Nr; ++j) {
+            for (const sources::Segment& seg : source_segments) {
+
+                if (seg.zone < 0) {
+                    for (int i = seg.begin; i < seg.end; ++i) row(i, j, 0.0, 0.0);
+                    continue;
+                }
+
+                const sources::Zone& zone = zones[seg.zone];
+
+                for (int i = seg.begin; i < seg.end; ++i) row(i, j, zone.mass(i), zone.heat(i));
+            }
+        }
+    }
+};
+
+Solver2D::Solver2D(const Input& in) {
+
+    Nz = in.N;
+    Nr = in.Nr;
+    L = in.L;
+    R = in.R;
+    dz = L / Nz;
+    dr = R / Nr;
+    dt = in.dt_user;
+
+    tot_outer_l = in.piso_outer_iter;
+    tot_inner_l = in.piso_inner_iter;
+    outer_tol_l = in.piso_outer_tol;
+    inner_tol_l = in.piso_inner_tol;
+    rhie_chow_on_off_l = in.rhie_chow_on_off_l;
+    wall_no_slip = in.wall_bc == 0;
+
+    adi_sweeps = std::max(in.adi_sweeps, 1);
+    adi_pressure_sweeps = std::max(in.adi_pressure_sweeps, 1);
+    adi_pressure_tol = in.adi_pressure_tol;
+
+    pressure_multigrid = in.pressure_solver == "multigrid";
+    mg_pressure_cycles = std::max(in.mg_pressure_cycles, 1);
+    mg_pressure_tol = in.mg_pressure_tol;
+    mg.cycle = in.mg_cycle == "W" ? multigrid::Cycle::W : multigrid::Cycle::V;
+    mg.pre_sweeps = in.mg_smoothing_sweeps;
+    mg.post_sweeps = in.mg_smoothing_sweeps;
+
+    rho_l = in.rho;
+    mu = in.mu;
+    k = in.k;
+    cp = in.cp;
+
+    u_inlet_value = in.u_inlet_value;
+    u_outlet_value = in.u_outlet_value;
+    u_inlet_bc = in.u_inlet_bc;
+    u_outlet_bc = in.u_outlet_bc;
+
+    T_inlet_value = in.T_inlet_value;
+    T_outlet_value = in.T_outlet_value;
+    T_inlet_bc = in.T_inlet_bc;
+    T_outlet_bc = in.T_outlet_bc;
+
+    p_inlet_value = in.p_inlet_value;
+    p_outlet_value = in.p_outlet_value;
+    p_inlet_bc = in.p_inlet_bc;
+    p_outlet_bc = in.p_outlet_bc;
+
+    r_c.resize(Nr);
+    r_f.resize(Nr + 1);
+
+    for (int j = 0; j < Nr; ++j) r_c[j] = (j + 0.5) * dr;
+    for (int j = 0; j <= Nr; ++j) r_f[j] = j * dr;
+
+    const int cells = Nz * Nr;
+
+    u_l.assign(cells, in.u_initial);
+    v_l.assign(cells, 0.0);
+    p_l.assign(cells, in.p_initial);
+    T_l.assign(cells, in.T_initial);
+
+    u_l_old = u_l;
+    v_l_old = v_l;
+    T_l_old = T_l;
+
+    p_prime_l.assign(cells, 0.0);
+    T_prev.assign(cells, 0.0);
+
+    u_face_l.assign((Nz + 1) * Nr, 0.0);
+    v_face_l.assign(Nz * (Nr + 1), 0.0);
+
+    define_source_zones(in, Nz, dz, in.S_m_cell, in.S_h_cell, zones, signals);
+    source_segments = sources::segments(zones, 1, Nz - 1);
+
+    drive_boundary_values(in, *this, signals);
+
+    mom_u.resize(Nz, Nr);
+    mom_v.resize(Nz, Nr);
+    pressure.resize(Nz, Nr);
+    energy.resize(Nz, Nr);
+
+    // RhieChow needs momentum diagonals before the first assembly
+    for (int j = 0; j < Nr; ++j) {
+        for (int i = 0; i < Nz; ++i) {
+            const double A_z = r_c[j] * dr;
+            mom_u.aP[id(i, j)] = (rho_l * dz / dt + 2 * mu / dz + mu / K * dz) * A_z;
+            mom_v.aP[id(i, j)] = mom_u.aP[id(i, j)];
+        }
+    }
+}
+
+void Solver2D::step() {
+
+    // Boundary values and sources are taken at the new time level
+    time_total += dt;
+    signals.apply(time_total);
+
+    // Saving old variables
+    u_l_old = u_l;
+    v_l_old = v_l;
+    T_l_old = T_l;
+
+    outer_l = 0;
+
+    momentum_residual = 1.0;
+    energy_residual = 1.0;
+
+    while (outer_l < tot_outer_l && (momentum_residual > outer_tol_l || energy_residual > outer_tol_l)) {
+
+        momentum_predictor();
+        solve_energy();
+        pressure_velocity_coupling();
+        compute_momentum_residual();
+
+        outer_l++;
+        total_inner_l += inner_l;
+        residual_checks_l += 2;
+    }
+
+    total_outer_l += outer_l;
+}
+
+// Face velocities: linear average plus the RhieChow correction of the 1D
+// solver, along z with the u-momentum diagonals and along r with the
+// v-momentum ones. The axis and wall faces carry no flux.
+void Solver2D::update_face_velocities() {
+
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < Nr; ++j) {
+
+        const double A_z = r_c[j] * dr;
+
+        for (int f = 1; f < Nz; ++f) {
+
+            const double d = discretization::face_inverse_diagonal(
+                mom_u.aP[id(f - 1, j)] / A_z, mom_u.aP[id(f, j)] / A_z);                           // [m2s/kg]
+
+            u_face_l[j * (Nz + 1) + f] = discretization::face_velocity(u_l[id(f - 1, j)], u_l[id(f, j)], d,
+                P(f - 2, j), P(f - 1, j), P(f, j), P(f + 1, j), rhie_chow_on_off_l);
+        }
+
+        u_face_l[j * (Nz + 1)] = u_l[id(0, j)];
+        u_face_l[j * (Nz + 1) + Nz] = u_l[id(Nz - 1, j)];
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int f = 0; f <= Nr; ++f) {
+
+        if (f == 0 || f == Nr) {
+            for (int i = 0; i < Nz; ++i) v_face_l[f * Nz + i] = 0.0;
+            continue;
+        }
+
+        const double A_l = r_c[f - 1] * dz;
+        const double A_r = r_c[f] * dz;
+
+        for (int i = 0; i < Nz; ++i) {
+
+            const double d = discretization::face_inverse_diagonal(
+                mom_v.aP[id(i, f - 1)] / A_l, mom_v.aP[id(i, f)] / A_r);                           // [m2s/kg]
+
+            v_face_l[f * Nz + i] = discretization::face_velocity(v_l[id(i, f - 1)], v_l[id(i, f)], d,
+                P(i, f - 2), P(i, f - 1), P(i, f), P(i, f + 1), rhie_chow_on_off_l);
+        }
+    }
+}
+
+// ===========================================================
+// MOMENTUM PREDICTOR
+// ===========================================================
+
+void Solver2D::momentum_predictor() {
+
+    update_face_velocities();
+
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < Nr; ++j) {
+
+        const double V = r_c[j] * dr * dz;                  // [m3]
+        const double A_z = r_c[j] * dr;                     // [m2]
+        const double A_s = r_f[j] * dz;                     // [m2]
+        const double A_n = r_f[j + 1] * dz;                 // [m2]
+
+        const double D_z = mu * A_z / dz;                   // [kg/s]
+        const double D_s = j > 0 ? mu * A_s / dr : 0.0;     // [kg/s]
+        const double D_n = j < Nr - 1 ? mu * A_n / dr : 0.0;        // [kg/s]
+        const double D_wall = j == Nr - 1 ? mu * A_n / (0.5 * dr) : 0.0;  // [kg/s]
+
+        for (int i = 1; i < Nz - 1; ++i) {
+
+            const int c = id(i, j);
+
+            const double F_w = rho_l * u_face_l[j * (Nz + 1) + i] * A_z;        // [kg/s]
+            const double F_e = rho_l * u_face_l[j * (Nz + 1) + i + 1] * A_z;    // [kg/s]
+            const double F_s = rho_l * v_face_l[j * Nz + i] * A_s;              // [kg/s]
+            const double F_n = rho_l * v_face_l[(j + 1) * Nz + i] * A_n;        // [kg/s]
+
+            const auto axial = discretization::upwind(F_w, F_e, D_z, D_z);
+            const auto radial = discretization::upwind(F_s, F_n, D_s, D_n);
+
+            const double aP =
+                + axial.outflow + radial.outflow
+                + 2 * D_z + D_s + D_n
+                + rho_l * V / dt
+                + discretization::drag(*this, std::hypot(u_l[c], v_l[c]), V);     // [kg/s]
+
+            for (adi::Stencil* s : { &mom_u, &mom_v }) {
+                s->aW[c] = -axial.a; s->aE[c] = -axial.c;
+                s->aS[c] = -radial.a; s->aN[c] = -radial.c;
+            }
+
+            mom_u.aP[c] = aP + (wall_no_slip ? D_wall : 0.0);
+            mom_u.b[c] = discretization::momentum_source(*this, P(i - 1, j), P(i + 1, j), u_l_old[c], A_z, V);    // [N]
+
+            // The wall is impermeable in any case; mu v / r^2 is the hoop stress
+            mom_v.aP[c] = aP + D_wall + mu * V / (r_c[j] * r_c[j]);
+            mom_v.b[c] = discretization::momentum_source(*this, P(i, j - 1), P(i, j + 1), v_l_old[c], r_c[j] * dz, V);    // [N]
+        }
+
+        // BCs: the 1D rows, the radial velocity vanishing at a Dirichlet
+        // inlet/outlet and having zero gradient at a Neumann one. The rows
+        // also carry the porous drag: they hold for any scaling, and scaled
+        // like the interior rows they keep the RhieChow coefficients of the
+        // first and last interior faces consistent with the corrections.
+        const int first = id(0, j);
+        const int last = id(Nz - 1, j);
+
+        const auto row_first = discretization::boundary_row(u_inlet_bc,
+            discretization::momentum_boundary_diagonal(*this, D_z, rho_l * 0.5 * u_l[id(1, j)] * A_z, V)
+            + discretization::drag(*this, std::abs(u_l[first]), V), u_inlet_value);
+        const auto row_last = discretization::boundary_row(u_outlet_bc,
+            discretization::momentum_boundary_diagonal(*this, D_z, -rho_l * 0.5 * u_l[id(Nz - 2, j)] * A_z, V)
+            + discretization::drag(*this, std::abs(u_l[last]), V), u_outlet_value);
+
+        for (adi::Stencil* s : { &mom_u, &mom_v }) {
+
+            s->aW[first] = 0.0; s->aS[first] = 0.0; s->aN[first] = 0.0;
+            s->aP[first] = row_first.diag;
+            s->aE[first] = -row_first.neighbour;
+
+            s->aE[last] = 0.0; s->aS[last] = 0.0; s->aN[last] = 0.0;
+            s->aP[last] = row_last.diag;
+            s->aW[last] = -row_last.neighbour;
+        }
+
+        mom_u.b[first] = row_first.rhs;
+        mom_u.b[last] = row_last.rhs;
+        mom_v.b[first] = 0.0;
+        mom_v.b[last] = 0.0;
+    }
+
+    adi::relax(mom_u, u_l, adi_sweeps, work);
+    adi::relax(mom_v, v_l, adi_sweeps, work);
+}
+
+// ===============================================================
+// TEMPERATURE SOLVER
+// ===============================================================
+
+void Solver2D::solve_energy() {
+
+    update_face_velocities();
+
+    const double alpha = k / (rho_l * cp);      // [m2/s]
+
+    // Energy equation for T (implicit), upwind convection, central diffusion
+    for_interior_cells([&](int i, int j, double S_m_i, double S_h_i) {
+
+        const int c = id(i, j);
+
+        const double V = r_c[j] * dr * dz;
+        const double A_z = r_c[j] * dr;
+        const double A_s = r_f[j] * dz;
+        const double A_n = r_f[j + 1] * dz;
+
+        const double D_z = alpha * A_z / dz;                        // [m3/s]
+        const double D_s = j > 0 ? alpha * A_s / dr : 0.0;          // [m3/s]
+        const double D_n = j < Nr - 1 ? alpha * A_n / dr : 0.0;     // [m3/s]
+
+        const double F_w = u_face_l[j * (Nz + 1) + i] * A_z;        // [m3/s]
+        const double F_e = u_face_l[j * (Nz + 1) + i + 1] * A_z;    // [m3/s]
+        const double F_s = v_face_l[j * Nz + i] * A_s;              // [m3/s]
+        const double F_n = v_face_l[(j + 1) * Nz + i] * A_n;        // [m3/s]
+
+        const auto axial = discretization::upwind(F_w, F_e, D_z, D_z);
+        const auto radial = discretization::upwind(F_s, F_n, D_s, D_n);
+
+        energy.aW[c] = -axial.a; energy.aE[c] = -axial.c;
+        energy.aS[c] = -radial.a; energy.aN[c] = -radial.c;
+
+        energy.aP[c] =
+            + axial.outflow + radial.outflow
+            + 2 * D_z + D_s + D_n
+            + V / dt;                                               // [m3/s]
+
+        energy.b[c] = discretization::energy_source(*this, T_l_old[c], S_m_i, S_h_i, V);     // [K m3/s]
+    });
+
+    // BCs on temperature
+    for (int j = 0; j < Nr; ++j) {
+
+        const int first = id(0, j);
+        const int last = id(Nz - 1, j);
+
+        const auto row_first = discretization::boundary_row(T_inlet_bc, 1.0, T_inlet_value);
+        const auto row_last = discretization::boundary_row(T_outlet_bc, 1.0, T_outlet_value);
+
+        energy.aW[first] = 0.0; energy.aS[first] = 0.0; energy.aN[first] = 0.0;
+        energy.aP[first] = row_first.diag;
+        energy.aE[first] = -row_first.neighbour;
+        energy.b[first] = row_first.rhs;
+
+        energy.aE[last] = 0.0; energy.aS[last] = 0.0; energy.aN[last] = 0.0;
+        energy.aP[last] = row_last.diag;
+        energy.aW[last] = -row_last.neighbour;
+        energy.b[last] = row_last.rhs;
+    }
+
+    T_prev = T_l;
+    adi::relax(energy, T_l, adi_sweeps, work);
+
+    energy_residual = 0.0;
+
+    for (int c = 0; c < Nz * Nr; ++c)
+        energy_residual = std::max(energy_residual, std::abs(T_l[c] - T_prev[c]));
+}
+
+// ===============================================================
+// PRESSURE-VELOCITY COUPLING
+// ===============================================================
+
+void Solver2D::pressure_velocity_coupling() {
+
+    inner_l = 0;
+    continuity_residual = 1.0;
+
+    update_face_velocities();
+
+    while (inner_l < tot_inner_l && continuity_residual > inner_tol_l) {
+
+        assemble_pressure_correction();
+        solve_pressure_correction();
+
+        correct_pressure();
+        correct_velocity();
+
+        inner_l++;
+
+        compute_continuity_residual();
+    }
+}
+
+// Five-point pressure correction from the face mass imbalances. Assumes the
+// face velocities are up to date.
+void Solver2D::assemble_pressure_correction() {
+
+    for_interior_cells([&](int i, int j, double S_m_i, double) {
+
+        const int c = id(i, j);
+
+        const double V = r_c[j] * dr * dz;
+        const double A_z = r_c[j] * dr;
+        const double A_s = r_f[j] * dz;
+        const double A_n = r_f[j + 1] * dz;
+
+        using discretization::face_inverse_diagonal;
+
+        const double d_w = face_inverse_diagonal(mom_u.aP[c - 1] / A_z, mom_u.aP[c] / A_z);    // [m2s/kg]
+        const double d_e = face_inverse_diagonal(mom_u.aP[c + 1] / A_z, mom_u.aP[c] / A_z);    // [m2s/kg]
+        const double d_s = j > 0 ? face_inverse_diagonal(
+            mom_v.aP[c - Nz] / (r_c[j - 1] * dz), mom_v.aP[c] / (r_c[j] * dz)) : 0.0;           // [m2s/kg]
+        const double d_n = j < Nr - 1 ? face_inverse_diagonal(
+            mom_v.aP[c + Nz] / (r_c[j + 1] * dz), mom_v.aP[c] / (r_c[j] * dz)) : 0.0;           // [m2s/kg]
+
+        const double mass_imbalance = rho_l * (
+            + (u_face_l[j * (Nz + 1) + i + 1] - u_face_l[j * (Nz + 1) + i]) * A_z
+            + v_face_l[(j + 1) * Nz + i] * A_n
+            - v_face_l[j * Nz + i] * A_s);          // [kg/s]
+
+        pressure.aW[c] = rho_l * A_z * d_w;
+        pressure.aE[c] = rho_l * A_z * d_e;
+        pressure.aS[c] = rho_l * A_s * d_s;
+        pressure.aN[c] = rho_l * A_n * d_n;
+        pressure.aP[c] = pressure.aW[c] + pressure.aE[c] + pressure.aS[c] + pressure.aN[c];     // [m s]
+
+        pressure.b[c] = S_m_i * V - mass_imbalance;     // [kg/s]
+    });
+
+    // BCs on p_prime, eliminated into the first and last interior rows: a
+    // Dirichlet p_prime is zero, a Neumann one equals its neighbour. The
+    // boundary rows are left uncoupled and filled in after the solve.
+    for (int j = 0; j < Nr; ++j) {
+
+        const int first = id(0, j);
+        const int last = id(Nz - 1, j);
+
+        if (p_inlet_bc != 0) pressure.aP[first + 1] -= pressure.aW[first + 1];
+        if (p_outlet_bc != 0) pressure.aP[last - 1] -= pressure.aE[last - 1];
+        pressure.aW[first + 1] = 0.0;
+        pressure.aE[last - 1] = 0.0;
+
+        pressure.aW[first] = 0.0; pressure.aE[first] = 0.0; pressure.aS[first] = 0.0; pressure.aN[first] = 0.0;
+        pressure.aP[first] = 1.0;
+        pressure.b[first] = 0.0;
+
+        pressure.aW[last] = 0.0; pressure.aE[last] = 0.0; pressure.aS[last] = 0.0; pressure.aN[last] = 0.0;
+        pressure.aP[last] = 1.0;
+        pressure.b[last] = 0.0;
+    }
+}
+
+// Multigrid cycles (or ADI sweeps) from a zero guess until the residual has
+// dropped by mg_pressure_tol (adi_pressure_tol) or the cycle (sweep) limit is
+// reached. The coarse operators are rebuilt from every new assembly.
+void Solver2D::solve_pressure_correction() {
+
+    std::fill(p_prime_l.begin(), p_prime_l.end(), 0.0);
+
+    const double r0 = adi::residual(pressure, p_prime_l);
+
+    if (r0 > 0.0 && pressure_multigrid) {
+
+        mg.build(pressure);
+
+        for (int cycle = 0; cycle < mg_pressure_cycles; ++cycle) {
+
+            mg.solve(p_prime_l);
+            pressure_cycles_l++;
+
+            if (adi::residual(pressure, p_prime_l) <= mg_pressure_tol * r0) break;
+        }
+    }
+    else if (r0 > 0.0) {
+        for (int sweep = 0; sweep < adi_pressure_sweeps; ++sweep) {
+
+            adi::relax(pressure, p_prime_l, 1, work);
+            pressure_sweeps_l++;
+
+            if (adi::residual(pressure, p_prime_l) <= adi_pressure_tol * r0) break;
+        }
+    }
+
+    // Eliminated Neumann boundary values
+    for (int j = 0; j < Nr; ++j) {
+        if (p_inlet_bc != 0) p_prime_l[id(0, j)] = p_prime_l[id(1, j)];
+        if (p_outlet_bc != 0) p_prime_l[id(Nz - 1, j)] = p_prime_l[id(Nz - 2, j)];
+    }
+}
+
+void Solver2D::correct_pressure() {
+
+    for (int c = 0; c < Nz * Nr; ++c) p_l[c] += p_prime_l[c];
+
+    // BCs on pressure
+    for (int j = 0; j < Nr; ++j) {
+
+        p_l[id(0, j)] = p_inlet_bc == 0 ? p_inlet_value : p_l[id(1, j)];
+        p_l[id(Nz - 1, j)] = p_outlet_bc == 0 ? p_outlet_value : p_l[id(Nz - 2, j)];
+    }
+}
+
+void Solver2D::correct_velocity() {
+
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < Nr; ++j) {
+
+        const int j_s = std::max(j - 1, 0);
+        const int j_n = std::min(j + 1, Nr - 1);
+
+        for (int i = 1; i < Nz - 1; ++i) {
+
+            const int c = id(i, j);
+
+            u_l[c] -= discretization::velocity_correction(p_prime_l[c - 1], p_prime_l[c + 1], mom_u.aP[c] / (r_c[j] * dr));
+            v_l[c] -= discretization::velocity_correction(p_prime_l[id(i, j_s)], p_prime_l[id(i, j_n)], mom_v.aP[c] / (r_c[j] * dz));
+        }
+    }
+}
+
+// -------------------------------------------------------
+// RESIDUALS
+// -------------------------------------------------------
+
+// The 1D continuity residual over the axial and radial faces, gathered row
+// by row. Leaves the face velocities up to date.
+void Solver2D::compute_continuity_residual() {
+
+    residual_checks_l++;
+
+    update_face_velocities();
+
+    std::vector<discretization::ContinuityResidual> rows(Nr);
+
+    for_interior_cells([&](int i, int j, double S_m_i, double) {
+
+        const int c = id(i, j);
+
+        const double V = r_c[j] * dr * dz;
+        const double A_z = r_c[j] * dr;
+        const double A_s = r_f[j] * dz;
+        const double A_n = r_f[j + 1] * dz;
+
+        const double phi_w = rho_l * u_face_l[j * (Nz + 1) + i] * A_z;
+        const double phi_e = rho_l * u_face_l[j * (Nz + 1) + i + 1] * A_z;
+        const double phi_s = rho_l * v_face_l[j * Nz + i] * A_s;
+        const double phi_n = rho_l * v_face_l[(j + 1) * Nz + i] * A_n;
+
+        discretization::ContinuityResidual& row = rows[j];
+
+        row.face(rho_l * 0.5 * (u_l[c - 1] + u_l[c]) * A_z);
+        row.face(rho_l * 0.5 * (u_l[c] + u_l[c + 1]) * A_z);
+        if (j > 0) row.face(rho_l * 0.5 * (v_l[c - Nz] + v_l[c]) * A_s);
+        if (j < Nr - 1) row.face(rho_l * 0.5 * (v_l[c] + v_l[c + Nz]) * A_n);
+
+        row.cell(S_m_i * V, phi_e - phi_w + phi_n - phi_s);
+    });
+
+    for (int j = 1; j < Nr; ++j) rows[0].merge(rows[j]);
+
+    continuity_residual = rows[0].value();
+}
+
+// Residual of the assembled momentum systems with the current pressure,
+// normalized as in 1D by the largest of the inertial, unsteady and viscous
+// force scales on the cell's axial face
+void Solver2D::compute_momentum_residual() {
+
+    double U_ref = 0.0;
+    for (int c = 0; c < Nz * Nr; ++c)
+        U_ref = std::max(U_ref, std::hypot(u_l[c], v_l[c]));
+
+    const double F_ref = discretization::momentum_scale(*this, U_ref);
+
+    momentum_residual = 0.0;
+
+    for (int j = 0; j < Nr; ++j) {
+
+        const double V = r_c[j] * dr * dz;
+        const double A_z = r_c[j] * dr;
+
+        for (int i = 1; i < Nz - 1; ++i) {
+
+            const int c = id(i, j);
+
+            auto R = [&](const adi::Stencil& s, const std::vector<double>& x, double b) {
+                return b - s.aP[c] * x[c]
+                    + s.aW[c] * x[c - 1] + s.aE[c] * x[c + 1]
+                    + (j > 0 ? s.aS[c] * x[c - Nz] : 0.0)
+                    + (j < Nr - 1 ? s.aN[c] * x[c + Nz] : 0.0);
+            };
+
+            const double b_u = discretization::momentum_source(*this, P(i - 1, j), P(i + 1, j), u_l_old[c], A_z, V);
+            const double b_v = discretization::momentum_source(*this, P(i, j - 1), P(i, j + 1), v_l_old[c], r_c[j] * dz, V);
+
+            momentum_residual = std::max({ momentum_residual,
+                std::abs(R(mom_u, u_l, b_u)) / (F_ref * A_z),
+                std::abs(R(mom_v, v_l, b_v)) / (F_ref * A_z) });
+        }
+    }
+}
+
+// Time loop of an axisymmetric case. Each output appends one block per field:
+// Nr lines (axis to wall) of Nz values, followed by an empty line.
+int run_axisymmetric(const Input& in, const std::string& inputFile) {
+
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);    // Number of time steps [-]
+    const int print_every = time_steps / in.number_output;                      // Print output every n time steps [-]
+
+    Solver2D solver(in);
+
+    fs::path outputDir = fs::path("output") / fs::path(inputFile).filename();
+    fs::create_directories(outputDir);
+
+    std::ofstream u_out(outputDir / in.velocity_file);              // Axial velocity output file
+    std::ofstream v_out(outputDir / in.radial_velocity_file);       // Radial velocity output file
+    std::ofstream p_out(outputDir / in.pressure_file);              // Pressure output file
+    std::ofstream T_out(outputDir / in.temperature_file);           // Temperature output file
+
+    std::vector<double> u_snapshot, v_snapshot, p_snapshot, T_snapshot;
+    std::future<void> pending_output;
+
+    auto write = [&](std::ofstream& out, const std::vector<double>& field) {
+        for (int j = 0; j < solver.Nr; ++j) {
+            for (int i = 0; i < solver.Nz; ++i)
+                out << field[solver.id(i, j)] << ", ";
+            out << "\n";
+        }
+        out << "\n";
+    };
+
+    double start = omp_get_wtime();
+
+    for (int n = 0; n <= time_steps; ++n) {
+
+        solver.step();
+
+        if (n % print_every == 0) {
+
+            if (pending_output.valid()) pending_output.wait();
+
+            u_snapshot = solver.u_l;
+            v_snapshot = solver.v_l;
+            p_snapshot = solver.p_l;
+            T_snapshot = solver.T_l;
+
+            pending_output = std::async(std::launch::async, [&]() {
+                write(u_out, u_snapshot);
+                write(v_out, v_snapshot);
+                write(p_out, p_snapshot);
+                write(T_out, T_snapshot);
+            });
+        }
+    }
+
+    if (pending_output.valid()) pending_output.wait();
+
+    double end = omp_get_wtime();
+    printf("Execution time: %.6f s\n", end - start);
+
+    printf("PISO iterations: %lld outer, %lld inner, %lld residual evaluations\n",
+        solver.total_outer_l, solver.total_inner_l, solver.residual_checks_l);
+    if (solver.pressure_multigrid)
+        printf("Multigrid pressure-correction cycles: %lld\n", solver.pressure_cycles_l);
+    else
+        printf("ADI pressure-correction sweeps: %lld\n", solver.pressure_sweeps_l);
+
+    return 0;
+}
+
+#pragma endregion
+
+#pragma region reduced order
+
+// =======================================================================
+//                        REDUCED-ORDER SURROGATE
+// =======================================================================
+
+// Inputs a surrogate can be parameterized by, and sensitivities taken to
+const std::vector<std::pair<std::string, double Input::*>> parameter_table = {
+    { "S_m_cell", &Input::S_m_cell },
+    { "S_h_cell", &Input::S_h_cell },
+    { "u_inlet_value", &Input::u_inlet_value },
+    { "u_outlet_value", &Input::u_outlet_value },
+    { "T_inlet_value", &Input::T_inlet_value },
+    { "T_outlet_value", &Input::T_outlet_value },
+    { "p_inlet_value", &Input::p_inlet_value },
+    { "p_outlet_value", &Input::p_outlet_value },
+    { "rho", &Input::rho },
+    { "mu", &Input::mu },
+    { "k", &Input::k },
+    { "cp", &Input::cp },
+};
+
+// Parameter sets of a training or query file: one set of `count` values per
+// line, separated by blanks or commas, '#' starting a comment
+std::vector<std::vector<double>> read_parameter_sets(const std::string& filename, std::size_t count) {
+
+    std::ifstream file(filename);
+    if (!file)
+        throw std::runtime_error("ROM: parameter file not found: " + filename);
+
+    std::vector<std::vector<double>> sets;
+    std::string line;
+
+    while (std::getline(file, line)) {
+
+        auto comment = line.find('#');
+        if (comment != std::string::npos)
+            line = line.substr(0, comment);
+
+        std::replace(line.begin(), line.end(), ',', ' ');
+
+        std::istringstream row(line);
+        std::vector<double> values;
+        double value;
+        while (row >> value) values.push_back(value);
+
+        if (values.empty()) continue;
+        if (values.size() != count)
+            throw std::runtime_error("ROM: wrong number of parameters in " + filename);
+
+        sets.push_back(values);
+    }
+
+    return sets;
+}
+
+// Steady fields of one parameter set
+struct Sample {
+    std::vector<double> parameters;
+    std::vector<double> u, p, T;
+    std::vector<double> jacobian;           // Reduced Jacobian near this sample, once the surrogate needed it
+};
+
+// Full PISO run from the initial fields, stopping once the largest change of
+// u, p and T over a time step, relative to each field's magnitude, falls
+// below rom_steady_tol (or at simulation_time)
+Sample full_steady_run(const Input& in, const std::vector<double>& parameters, int& steps) {
+
+    Solver solver(in);
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+
+    for (steps = 1; steps <= time_steps; ++steps) {
+
+        solver.step();
+        if (solver.step_change() <= in.rom_steady_tol) break;
+    }
+
+    return { parameters, solver.u_l, solver.p_l, solver.T_l, {} };
+}
+
+// POD-Galerkin model of the steady states. Each field has its own POD basis
+// and the unknowns are the modal coordinates of all three; the steady
+// momentum, continuity and energy residuals are tested with the u, p and T
+// modes respectively. The reduced equations are solved by Newton iterations
+// with a finite-difference Jacobian, starting from the nearest sample. The
+// normalized full-order residual of the result is the error estimate, in the
+// same per-time-step terms as rom_steady_tol.
+struct Surrogate {
+
+    std::vector<Sample> samples;
+    rom::Basis u, p, T;
+
+    int size() const { return u.size() + p.size() + T.size(); }
+
+    void build(double pod_tol) {
+
+        std::vector<std::vector<double>> us, ps, Ts;
+        for (const Sample& s : samples) {
+            us.push_back(s.u);
+            ps.push_back(s.p);
+            Ts.push_back(s.T);
+        }
+
+        u = rom::pod(us, pod_tol);
+        p = rom::pod(ps, pod_tol);
+        T = rom::pod(Ts, pod_tol);
+
+        for (Sample& s : samples) s.jacobian.clear();
+    }
+
+    // Solves the reduced model with the equations of `solver`, which holds the
+    // resulting fields on return, until its normalized residual is below
+    // `tol`. Returns the normalized full-order residual.
+    double evaluate(Solver& solver, const std::vector<double>& parameters, double tol, int& iterations) {
+
+        const int Ku = u.size(), Kp = p.size(), K = size();
+        const int M = static_cast<int>(samples.size());
+
+        // Nearest sample, parameter distances relative to the training spread
+        std::vector<double> spread(parameters.size(), 1e-30);
+        for (std::size_t q = 0; q < parameters.size(); ++q) {
+            double lo = samples[0].parameters[q], hi = lo;
+            for (const Sample& s : samples) {
+                lo = std::min(lo, s.parameters[q]);
+                hi = std::max(hi, s.parameters[q]);
+            }
+            spread[q] = std::max(hi - lo, 1e-30);
+        }
+
+        Sample* nearest = &samples[0];
+        double best = std::numeric_limits<double>::max();
+
+        for (Sample& s : samples) {
+            double d = 0.0;
+            for (std::size_t q = 0; q < parameters.size(); ++q)
+                d += std::pow((parameters[q] - s.parameters[q]) / spread[q], 2);
+            if (d < best) { best = d; nearest = &s; }
+        }
+
+        std::vector<double> a(K), amplitude(K);
+        const std::vector<double> a_u = u.project(nearest->u), a_p = p.project(nearest->p), a_T = T.project(nearest->T);
+        std::copy(a_u.begin(), a_u.end(), a.begin());
+        std::copy(a_p.begin(), a_p.end(), a.begin() + Ku);
+        std::copy(a_T.begin(), a_T.end(), a.begin() + Ku + Kp);
+
+        // Scale of the FD step and of the convergence test of every coordinate:
+        // its RMS over the samples, but at least a small fraction of the field
+        auto norm2 = [](const std::vector<double>& x) {
+            double s = 0.0;
+            for (double v : x) s += v * v;
+            return std::sqrt(s);
+        };
+        const double u_size = norm2(u.mean), p_size = norm2(p.mean), T_size = norm2(T.mean);
+
+        for (int k = 0; k < K; ++k) {
+            const double sigma = k < Ku ? u.sigma[k] : k < Ku + Kp ? p.sigma[k - Ku] : T.sigma[k - Ku - Kp];
+            const double size = k < Ku ? u_size : k < Ku + Kp ? p_size : T_size;
+            amplitude[k] = std::max(sigma / std::sqrt(static_cast<double>(M)), 1e-6 * size);
+        }
+
+        std::vector<double> r;
+        std::array<double, 3> scale{}, scale0{};
+        double estimate = 0.0;
+
+        auto expand = [&](const std::vector<double>& x) {
+            u.expand(x, 0, solver.u_l);
+            p.expand(x, Ku, solver.p_l);
+            T.expand(x, Ku + Kp, solver.T_l);
+            estimate = solver.steady_residual(r, scale);
+        };
+
+        // Galerkin residual, normalized with the scales of the starting state
+        auto reduced = [&](const std::vector<double>& x, std::vector<double>& g) {
+
+            expand(x);
+            g.assign(K, 0.0);
+
+            const int N = solver.N;
+            for (int k = 0; k < K; ++k) {
+                const int block = k < Ku ? 0 : k < Ku + Kp ? 1 : 2;
+                const std::vector<double>& mode = block == 0 ? u.modes[k] : block == 1 ? p.modes[k - Ku] : T.modes[k - Ku - Kp];
+                double sum = 0.0;
+                for (int i = 0; i < N; ++i) sum += mode[i] * r[block * N + i];
+                g[k] = sum / scale0[block];
+            }
+
+            double norm = 0.0;
+            for (double gk : g) norm = std::max(norm, std::abs(gk));
+            return norm;
+        };
+
+        expand(a);
+        scale0 = scale;
+
+        std::vector<double> g, g_trial, trial(K);
+        double norm = reduced(a, g);
+
+        // Chord iterations on the Jacobian cached with the nearest sample,
+        // refreshed at the current point whenever it stops halving the residual
+        std::vector<double>& J = nearest->jacobian;
+        bool fresh = false;
+
+        auto refresh = [&]() {
+
+            J.assign(static_cast<std::size_t>(K) * K, 0.0);
+
+            for (int k = 0; k < K; ++k) {
+
+                const double h = 1e-7 * std::max(std::abs(a[k]), amplitude[k]);
+                std::vector<double> probe = a;
+                probe[k] += h;
+
+                reduced(probe, g_trial);
+                for (int m = 0; m < K; ++m) J[m * K + k] = (g_trial[m] - g[m]) / h;
+            }
+
+            fresh = true;
+        };
+
+        if (J.size() != static_cast<std::size_t>(K) * K) refresh();
+
+        iterations = 0;
+
+        while (K > 0 && norm > tol && iterations < 20) {
+
+            iterations++;
+
+            std::vector<double> minus_g(K);
+            for (int k = 0; k < K; ++k) minus_g[k] = -g[k];
+
+            std::vector<double> da;
+            try {
+                da = rom::solve_dense(J, minus_g, K);
+            }
+            catch (const std::runtime_error&) {
+                if (fresh) break;
+                refresh();
+                continue;
+            }
+
+            double step_size = 1.0;
+            for (int k = 0; k < K; ++k) trial[k] = a[k] + da[k];
+            double norm_trial = reduced(trial, g_trial);
+
+            if (norm_trial > 0.5 * norm) {
+
+                if (!fresh) {
+                    refresh();
+                    continue;
+                }
+
+                // Newton step on a fresh Jacobian: halved until the residual decreases
+                for (int halving = 0; halving < 8 && norm_trial >= norm; ++halving) {
+                    step_size *= 0.5;
+                    for (int k = 0; k < K; ++k) trial[k] = a[k] + step_size * da[k];
+                    norm_trial = reduced(trial, g_trial);
+                }
+
+                if (norm_trial >= norm) break;
+            }
+
+            a = trial;
+            g = g_trial;
+            norm = norm_trial;
+            fresh = false;
+
+            double change = 0.0;
+            for (int k = 0; k < K; ++k) change = std::max(change, std::abs(step_size * da[k]) / amplitude[k]);
+
+            if (change < 1e-9) break;
+        }
+
+        // Leaves the solver with the fields of the final coordinates
+        expand(a);
+        return estimate;
+    }
+};
+
+// Surrogate mode: full runs at the training parameter sets provide the
+// snapshots, then every query is answered by the reduced model unless its
+// error estimate exceeds rom_tol, in which case the full solver runs instead
+// (and, with rom_enrich, its result joins the snapshots). The fields of every
+// query are written one line per query in the usual output files.
+int run_reduced_order(const Input& in, const std::string& inputFile) {
+
+    std::vector<double Input::*> fields;
+
+    for (const std::string& name : in.rom_parameters) {
+        auto entry = std::find_if(parameter_table.begin(), parameter_table.end(),
+            [&](const auto& e) { return e.first == name; });
+        if (entry == parameter_table.end())
+            throw std::runtime_error("ROM: unsupported parameter " + name);
+        fields.push_back(entry->second);
+    }
+
+    auto with = [&](const std::vector<double>& parameters) {
+        Input copy = in;
+        for (std::size_t q = 0; q < fields.size(); ++q) copy.*fields[q] = parameters[q];
+        return copy;
+    };
+
+    const std::vector<std::vector<double>> training = read_parameter_sets(in.rom_training_file, fields.size());
+    const std::vector<std::vector<double>> queries = read_parameter_sets(in.rom_query_file, fields.size());
+
+    if (training.size() < 2)
+        throw std::runtime_error("ROM: at least two training sets are needed");
+
+    fs::path outputDir = fs::path("output") / fs::path(inputFile).filename();
+    fs::create_directories(outputDir);
+
+    // Offline: snapshots and bases
+    double start = omp_get_wtime();
+
+    Surrogate surrogate;
+    long long full_steps = 0;
+
+    for (const std::vector<double>& parameters : training) {
+        int steps = 0;
+        surrogate.samples.push_back(full_steady_run(with(parameters), parameters, steps));
+        full_steps += steps;
+    }
+
+    surrogate.build(in.rom_pod_tol);
+
+    const double offline_time = omp_get_wtime() - start;
+
+    printf("Training: %zu full runs (%lld time steps) in %.6f s\n", training.size(), full_steps, offline_time);
+    printf("POD modes: %d velocity, %d pressure, %d temperature\n",
+        surrogate.u.size(), surrogate.p.size(), surrogate.T.size());
+
+    // Online: queries
+    std::ofstream v_out(outputDir / in.velocity_file);
+    std::ofstream p_out(outputDir / in.pressure_file);
+    std::ofstream T_out(outputDir / in.temperature_file);
+    std::ofstream results(outputDir / in.rom_results_file);
+
+    results << "#";
+    for (const std::string& name : in.rom_parameters) results << " " << name;
+    results << " estimate model newton_iterations time_us\n";
+
+    auto write = [](std::ofstream& out, const std::vector<double>& field) {
+        for (double value : field) out << value << ", ";
+        out << "\n";
+    };
+
+    int accepted = 0, fallbacks = 0;
+    double rom_time = 0.0, full_time = 0.0;
+
+    for (const std::vector<double>& parameters : queries) {
+
+        const double t0 = omp_get_wtime();
+
+        const Input query = with(parameters);
+        Solver solver(query);
+
+        int iterations = 0;
+        const double estimate = surrogate.evaluate(solver, parameters, 1e-3 * in.rom_tol, iterations);
+
+        const double t1 = omp_get_wtime();
+        const bool trusted = estimate <= in.rom_tol;
+
+        Sample result{ parameters, solver.u_l, solver.p_l, solver.T_l, {} };
+
+        if (trusted) {
+            accepted++;
+            rom_time += t1 - t0;
+        }
+        else {
+            int steps = 0;
+            result = full_steady_run(query, parameters, steps);
+            fallbacks++;
+
+            if (in.rom_enrich) {
+                surrogate.samples.push_back(result);
+                surrogate.build(in.rom_pod_tol);
+            }
+        }
+
+        const double t2 = omp_get_wtime();
+        if (!trusted) full_time += t2 - t0;
+
+        write(v_out, result.u);
+        write(p_out, result.p);
+        write(T_out, result.T);
+
+        for (double value : parameters) results << value << " ";
+        results << estimate << " " << (trusted ? "rom" : "full") << " " << iterations << " "
+            << 1e6 * (t2 - t0) << "\n";
+    }
+
+    printf("Queries: %d by the surrogate (mean %.1f us), %d by the full solver (mean %.6f s)\n",
+        accepted, accepted ? 1e6 * rom_time / accepted : 0.0,
+        fallbacks, fallbacks ? full_time / fallbacks : 0.0);
+    printf("POD modes after enrichment: %d velocity, %d pressure, %d temperature\n",
+        surrogate.u.size(), surrogate.p.size(), surrogate.T.size());
+
+    return 0;
+}
+
+#pragma endregion
+
+#pragma region sensitivity
+
+// =======================================================================
+//                     TANGENT-LINEAR SENSITIVITIES
+// =======================================================================
+
+// One run of the solver on dual numbers with P derivative components: the
+// fields and their derivatives with respect to the P parameters advance
+// together, so every sensitivity costs a fraction of a run instead of the two
+// runs per parameter of finite differences. Branches follow the values and
+// the iteration counts are those of the plain run, so the derivatives are the
+// exact ones of the discrete time marching. The derivative of every field with
+// respect to each parameter is written alongside the fields, and the
+// sensitivities of the outlet temperature and the pressure drop are printed.
+template <int P>
+int run_sensitivity_pass(const Input& in, const std::string& inputFile,
+    const std::vector<double Input::*>& parameters)
+{
+    using Real = dual::Dual<P>;
+
+    const int N = in.N;
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+    const int print_every = std::max(time_steps / in.number_output, 1);
+
+    BasicSolver<Real> solver(in, parameters);
+
+    fs::path outputDir = fs::path("output") / fs::path(inputFile).filename();
+    fs::create_directories(outputDir);
+
+    std::ofstream v_out(outputDir / in.velocity_file);
+    std::ofstream p_out(outputDir / in.pressure_file);
+    std::ofstream T_out(outputDir / in.temperature_file);
+
+    // Derivative files: "d_<parameter>_" prefixed to the field files
+    std::vector<std::array<std::ofstream, 3>> d_out(P);
+    for (int q = 0; q < P; ++q) {
+        const std::string prefix = "d_" + in.sensitivity_parameters[q] + "_";
+        d_out[q][0].open(outputDir / (prefix + in.velocity_file));
+        d_out[q][1].open(outputDir / (prefix + in.pressure_file));
+        d_out[q][2].open(outputDir / (prefix + in.temperature_file));
+    }
+
+    auto write = [&](const std::vector<Real>& field, std::ofstream& out, int which) {
+        for (int i = 0; i < N; ++i) out << dual::value(field[i]) << ", ";
+        out << "\n";
+        for (int q = 0; q < P; ++q) {
+            for (int i = 0; i < N; ++i) d_out[q][which] << dual::derivative(field[i], q) << ", ";
+            d_out[q][which] << "\n";
+        }
+    };
+
+    double start = omp_get_wtime();
+    int steps = 0;
+
+    for (int n = 0; n <= time_steps; ++n) {
+
+        solver.step();
+        steps = n + 1;
+
+        const bool steady = in.steady_tol > 0.0 && solver.step_change() <= in.steady_tol;
+
+        if (n % print_every == 0 || steady) {
+            write(solver.u_l, v_out, 0);
+            write(solver.p_l, p_out, 1);
+            write(solver.T_l, T_out, 2);
+        }
+
+        if (steady) break;
+    }
+
+    double end = omp_get_wtime();
+    printf("Execution time: %.6f s (%d time steps, %d derivative components)\n", end - start, steps, P);
+
+    const Real T_outlet = solver.T_l[N - 1];
+    const Real dp = solver.p_l[0] - solver.p_l[N - 1];
+
+    printf("Outlet temperature %.10g K, pressure drop %.10g Pa\n", dual::value(T_outlet), dual::value(dp));
+    for (int q = 0; q < P; ++q)
+        printf("  d/d %-15s  T_outlet: %+.10e  dp: %+.10e\n", in.sensitivity_parameters[q].c_str(),
+            dual::derivative(T_outlet, q), dual::derivative(dp, q));
+
+    return 0;
+}
+
+// The number of derivative components is a compile-time constant, so runs
+// are dispatched to the instantiation matching the parameter count
+int run_sensitivity(const Input& in, const std::string& inputFile) {
+
+    std::vector<double Input::*> parameters;
+
+    for (const std::string& name : in.sensitivity_parameters) {
+        auto entry = std::find_if(parameter_table.begin(), parameter_table.end(),
+            [&](const auto& e) { return e.first == name; });
+        if (entry == parameter_table.end())
+            throw std::runtime_error("Sensitivity: unsupported parameter " + name);
+        parameters.push_back(entry->second);
+    }
+
+    switch (parameters.size()) {
+    case 1: return run_sensitivity_pass<1>(in, inputFile, parameters);
+    case 2: return run_sensitivity_pass<2>(in, inputFile, parameters);
+    case 3: return run_sensitivity_pass<3>(in, inputFile, parameters);
+    case 4: return run_sensitivity_pass<4>(in, inputFile, parameters);
+    default:
+        throw std::runtime_error("Sensitivity: at most 4 parameters per run");
+    }
+}
+
+#pragma endregion
+
+#pragma region adjoint
+
+// =======================================================================
+//                           DISCRETE ADJOINT
+// =======================================================================
+
+// What a time step reads from the previous one: the fields, the momentum
+// diagonal (RhieChow face velocities of the first assembly) and the padded
+// pressure
+struct StepState {
+    std::vector<double> u, p, T, bLU, p_storage;
+    double time = 0.0;
+};
+
+// Solver parameters with adjoint gradients, in parameter_table order after
+// the source strengths
+const std::vector<std::pair<std::string, adjoint::Var BasicSolver<adjoint::Var>::*>> adjoint_members = {
+    { "u_inlet_value", &BasicSolver<adjoint::Var>::u_inlet_value },
+    { "u_outlet_value", &BasicSolver<adjoint::Var>::u_outlet_value },
+    { "T_inlet_value", &BasicSolver<adjoint::Var>::T_inlet_value },
+    { "T_outlet_value", &BasicSolver<adjoint::Var>::T_outlet_value },
+    { "p_inlet_value", &BasicSolver<adjoint::Var>::p_inlet_value },
+    { "p_outlet_value", &BasicSolver<adjoint::Var>::p_outlet_value },
+    { "rho", &BasicSolver<adjoint::Var>::rho_l },
+    { "mu", &BasicSolver<adjoint::Var>::mu },
+    { "k", &BasicSolver<adjoint::Var>::k },
+    { "cp", &BasicSolver<adjoint::Var>::cp },
+};
+
+// Discrete adjoint of the time marching for an objective of the final state.
+// A time step maps the state before it and the parameters to the state after
+// it. Reversing a step records it on a tape from its starting state and plays
+// the tape back from the adjoint of its end state, which gives the adjoint of
+// its starting state and its share of the parameter gradients; the momentum,
+// pressure-correction and energy solves are reversed by transposed tridiagonal
+// solves. The starting states come from binomial checkpointing (revolve): with
+// c stored states, t steps are reversed recomputing each step at most r times,
+// C(c + r, c) >= t, so memory is c states and one step's tape whatever the run
+// length. Every gradient (zone strengths, boundary values, properties and the
+// source of every cell) comes out of the same pass.
+struct AdjointMarch {
+
+    using Var = adjoint::Var;
+
+    Solver forward;                         // Recomputes the states between checkpoints
+    BasicSolver<Var> taped;                 // Records single steps
+    adjoint::Tape tape;
+
+    int steps = 0;                          // Time steps of the run [-]
+    std::string objective;
+    double J = 0.0;                         // Objective value
+
+    std::vector<double> lambda;             // Adjoint of the state after the step being reversed
+    std::vector<double> gradient_members;   // Gradients with respect to adjoint_members
+    std::vector<double> gradient_zone_m;    // Gradients with respect to the zone strengths
+    std::vector<double> gradient_zone_h;
+    std::vector<double> gradient_S_m;       // Gradients with respect to per-cell source additions
+    std::vector<double> gradient_S_h;
+
+    long long recomputed = 0;               // Forward steps taken to rebuild states [-]
+    int stored = 0;                         // Checkpoints currently held [-]
+    int stored_max = 0;
+    int tape_max = 0;                       // Largest tape of a step [nodes]
+
+    AdjointMarch(const Input& in, int steps);
+
+    static StepState capture(const Solver& s);
+    static void restore(Solver& s, const StepState& x);
+
+    StepState advance(const StepState& start, int count);
+    void reverse_step(int j, const StepState& start);
+    void reverse(int first, int last, const StepState& start, int free);
+};
+
+AdjointMarch::AdjointMarch(const Input& in, int steps)
+    : forward(in), taped(in), steps(steps), objective(in.adjoint_objective)
+{
+    const int N = in.N;
+
+    gradient_members.assign(adjoint_members.size(), 0.0);
+    gradient_zone_m.assign(taped.zones.size(), 0.0);
+    gradient_zone_h.assign(taped.zones.size(), 0.0);
+    gradient_S_m.assign(N, 0.0);
+    gradient_S_h.assign(N, 0.0);
+
+    taped.S_m_added.assign(N, 0.0);
+    taped.S_h_added.assign(N, 0.0);
+
+    // Adjoint of the final state: the objective's gradient
+    lambda.assign(4 * N + N + 2, 0.0);
+    if (objective == "T_outlet") {
+        lambda[2 * N + N - 1] = 1.0;
+    }
+    else {
+        lambda[N] = 1.0;
+        lambda[N + N - 1] = -1.0;
+    }
+}
+
+StepState AdjointMarch::capture(const Solver& s) {
+    return { s.u_l, s.p_l, s.T_l, s.bLU, s.p_storage_l, s.time_total };
+}
+
+// Copies in place: p_padded_l points into p_storage_l
+void AdjointMarch::restore(Solver& s, const StepState& x) {
+    std::copy(x.u.begin(), x.u.end(), s.u_l.begin());
+    std::copy(x.p.begin(), x.p.end(), s.p_l.begin());
+    std::copy(x.T.begin(), x.T.end(), s.T_l.begin());
+    std::copy(x.bLU.begin(), x.bLU.end(), s.bLU.begin());
+    std::copy(x.p_storage.begin(), x.p_storage.end(), s.p_storage_l.begin());
+    s.time_total = x.time;
+}
+
+StepState AdjointMarch::advance(const StepState& start, int count) {
+
+    restore(forward, start);
+    for (int n = 0; n < count; ++n) forward.step();
+    recomputed += count;
+
+    return capture(forward);
+}
+
+// Records step j from its starting state and turns lambda into the adjoint
+// of that state. All inputs are fresh tape variables, so the nodes left over
+// from the previous step in unassigned members are never reached.
+void AdjointMarch::reverse_step(int j, const StepState& start) {
+
+    tape.clear();
+    adjoint::Tape::active = &tape;
+
+    std::vector<int> inputs;
+    inputs.reserve(lambda.size());
+
+    auto bind = [&](std::vector<Var>& field, const std::vector<double>& values) {
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            field[i] = Var(values[i], tape.variable());
+            inputs.push_back(field[i].i);
+        }
+    };
+
+    bind(taped.u_l, start.u);
+    bind(taped.p_l, start.p);
+    bind(taped.T_l, start.T);
+    bind(taped.bLU, start.bLU);
+    bind(taped.p_storage_l, start.p_storage);
+    taped.time_total = start.time;
+
+    auto parameter = [&](Var& x) { x = Var(x.v, tape.variable()); return x.i; };
+
+    std::vector<int> members, zones_m, zones_h, cells_m, cells_h;
+    for (const auto& member : adjoint_members) members.push_back(parameter(taped.*member.second));
+    for (sources::BasicZone<Var>& zone : taped.zones) {
+        zones_m.push_back(parameter(zone.S_m));
+        zones_h.push_back(parameter(zone.S_h));
+    }
+    for (std::size_t i = 0; i < taped.S_m_added.size(); ++i) {
+        cells_m.push_back(parameter(taped.S_m_added[i]));
+        cells_h.push_back(parameter(taped.S_h_added[i]));
+    }
+
+    taped.step();
+
+    const int N = taped.N;
+    if (j == steps - 1)
+        J = objective == "T_outlet" ? taped.T_l[N - 1].v : taped.p_l[0].v - taped.p_l[N - 1].v;
+
+    // Seeds the adjoint of the end state, in the layout of the inputs
+    std::size_t k = 0;
+    auto seed = [&](const std::vector<Var>& field) {
+        for (const Var& x : field) {
+            if (x.i >= 0) tape.adjoint(x.i) += lambda[k];
+            ++k;
+        }
+    };
+
+    seed(taped.u_l);
+    seed(taped.p_l);
+    seed(taped.T_l);
+    seed(taped.bLU);
+    seed(taped.p_storage_l);
+
+    tape_max = std::max(tape_max, tape.size());
+    tape.reverse();
+
+    for (std::size_t q = 0; q < inputs.size(); ++q) lambda[q] = tape.adjoint(inputs[q]);
+
+    for (std::size_t q = 0; q < members.size(); ++q) gradient_members[q] += tape.adjoint(members[q]);
+    for (std::size_t z = 0; z < zones_m.size(); ++z) {
+        gradient_zone_m[z] += tape.adjoint(zones_m[z]);
+        gradient_zone_h[z] += tape.adjoint(zones_h[z]);
+    }
+    for (std::size_t i = 0; i < cells_m.size(); ++i) {
+        gradient_S_m[i] += tape.adjoint(cells_m[i]);
+        gradient_S_h[i] += tape.adjoint(cells_h[i]);
+    }
+
+    adjoint::Tape::active = nullptr;
+}
+
+// Reverses steps [first, last) given the state before `first` and `free`
+// checkpoint slots. The split leaves the later part C(free - 1 + r, free - 1)
+// steps, which it reverses with one slot less, and the earlier part at most
+// C(free + r - 1, free), reversed with one repetition less.
+void AdjointMarch::reverse(int first, int last, const StepState& start, int free) {
+
+    const int count = last - first;
+
+    if (count == 1) {
+        reverse_step(first, start);
+        return;
+    }
+
+    // No slot left: each step is rebuilt from the start
+    if (free == 0) {
+        for (int j = last - 1; j >= first; --j) reverse_step(j, advance(start, j - first));
+        return;
+    }
+
+    auto binomial = [](int n, int k) {
+        double b = 1.0;
+        for (int i = 1; i <= k; ++i) b = b * (n - k + i) / i;
+        return b;
+    };
+
+    int r = 1;
+    while (binomial(free + r, free) < count) ++r;
+
+    const int later = static_cast<int>(std::min<double>(binomial(free - 1 + r, free - 1), count - 1));
+    const int mid = last - later;
+
+    const StepState checkpoint = advance(start, mid - first);
+    stored_max = std::max(stored_max, ++stored);
+
+    reverse(mid, last, checkpoint, free - 1);
+    --stored;
+
+    reverse(first, mid, start, free);
+}
+
+// Adjoint gradient run. Passive scalars do not act on the flow, so they are
+// left out; concurrent phases and speculative inner iterations are off, as a
+// step is recorded on a single tape. The gradients are written with the zone
+// strengths summed into S_m_cell and S_h_cell (condenser zones with opposite
+// sign), plus the gradients with respect to a source added to each cell.
+int run_adjoint(const Input& in, const std::string& inputFile) {
+
+    Input plain = in;
+    plain.scalars.clear();
+    plain.task_graph = false;
+    plain.piso_speculative = false;
+    plain.momentum_freeze_tol = 0.0;
+    plain.piso_step_time_budget = 0.0;         // Recomputed steps must repeat the recorded ones
+
+    const int N = in.N;
+    const int steps = static_cast<int>(in.simulation_time / in.dt_user) + 1;
+
+    double start = omp_get_wtime();
+
+    AdjointMarch march(plain, steps);
+    march.reverse(0, steps, AdjointMarch::capture(march.forward), in.adjoint_checkpoints);
+
+    // The initial momentum diagonal is the only part of the initial state
+    // depending on the parameters: rho dz / dt + 2 mu / dz
+    auto member = [](const std::string& name) {
+        return std::find_if(adjoint_members.begin(), adjoint_members.end(),
+            [&](const auto& e) { return e.first == name; }) - adjoint_members.begin();
+    };
+
+    const double dz = in.L / N;
+    for (int i = 0; i < N; ++i) {
+        const double lambda_bLU = march.lambda[3 * N + i];
+        march.gradient_members[member("rho")] += lambda_bLU * dz / in.dt_user;
+        march.gradient_members[member("mu")] += lambda_bLU * 2.0 / dz;
+    }
+
+    double end = omp_get_wtime();
+
+    // Zone signs from unit strengths
+    std::vector<sources::Zone> unit;
+    Signals unit_signals;
+    define_source_zones(plain, N, dz, 1.0, 1.0, unit, unit_signals);
+
+    double gradient_S_m_cell = 0.0, gradient_S_h_cell = 0.0;
+    for (std::size_t z = 0; z < unit.size(); ++z) {
+        gradient_S_m_cell += unit[z].S_m * march.gradient_zone_m[z];
+        gradient_S_h_cell += unit[z].S_h * march.gradient_zone_h[z];
+    }
+
+    fs::path outputDir = fs::path("output") / fs::path(inputFile).filename();
+    fs::create_directories(outputDir);
+
+    std::ofstream out(outputDir / in.adjoint_gradient_file);
+    out.precision(12);
+
+    out << "# d" << in.adjoint_objective << "/d parameter, " << in.adjoint_objective << " = " << march.J
+        << " after " << steps << " time steps\n";
+    out << "S_m_cell " << gradient_S_m_cell << "\n";
+    out << "S_h_cell " << gradient_S_h_cell << "\n";
+    for (std::size_t q = 0; q < adjoint_members.size(); ++q)
+        out << adjoint_members[q].first << " " << march.gradient_members[q] << "\n";
+
+    out << "# cell, z [m], d" << in.adjoint_objective << "/d S_m, d" << in.adjoint_objective << "/d S_h of a source added to the cell\n";
+    for (int i = 1; i < N - 1; ++i)
+        out << i << " " << (i + 0.5) * dz << " " << march.gradient_S_m[i] << " " << march.gradient_S_h[i] << "\n";
+
+    printf("Execution time: %.6f s (%d time steps, %lld recomputed, %d of %d checkpoints, largest tape %d nodes)\n",
+        end - start, steps, march.recomputed, march.stored_max, in.adjoint_checkpoints, march.tape_max);
+    printf("%s = %.10g\n", in.adjoint_objective.c_str(), march.J);
+    printf("  d/d %-15s  %+.10e\n", "S_m_cell", gradient_S_m_cell);
+    printf("  d/d %-15s  %+.10e\n", "S_h_cell", gradient_S_h_cell);
+    for (std::size_t q = 0; q < adjoint_members.size(); ++q)
+        printf("  d/d %-15s  %+.10e\n", adjoint_members[q].first.c_str(), march.gradient_members[q]);
+
+    return 0;
+}
+
+#pragma endregion
+
+#pragma region uncertainty
+
+// =======================================================================
+//                      UNCERTAINTY QUANTIFICATION
+// =======================================================================
+
+// Scalar outputs of the final fields a UQ run can take statistics of
+const std::vector<std::pair<std::string, double (*)(const Solver&)>> output_table = {
+    { "T_outlet", [](const Solver& s) { return s.T_l[s.N - 1]; } },
+    { "T_max", [](const Solver& s) { return *std::max_element(s.T_l.begin(), s.T_l.end()); } },
+    { "T_mean", [](const Solver& s) { return std::accumulate(s.T_l.begin(), s.T_l.end(), 0.0) / s.N; } },
+    { "pressure_drop", [](const Solver& s) { return s.p_l[0] - s.p_l[s.N - 1]; } },
+    { "u_outlet", [](const Solver& s) { return s.u_l[s.N - 1]; } },
+};
+
+// Stochastic collocation: the outputs are expanded in polynomial chaos of the
+// uncertain inputs from full runs at the points of a Smolyak sparse grid of
+// Gauss rules. The points are independent runs, spread over the threads with
+// one single-threaded solver each; a run stops at steady_tol if set, at
+// simulation_time otherwise. Mean, variance and Sobol indices follow from the
+// expansion coefficients. For outputs smooth in the inputs the error falls
+// geometrically with the level, against N^-1/2 for N Monte Carlo samples.
+int run_uncertainty(const Input& in, const std::string& inputFile) {
+
+    std::vector<double Input::*> fields;
+    for (const std::string& name : in.uq_parameters) {
+        auto entry = std::find_if(parameter_table.begin(), parameter_table.end(),
+            [&](const auto& e) { return e.first == name; });
+        if (entry == parameter_table.end())
+            throw std::runtime_error("UQ: unsupported parameter " + name);
+        fields.push_back(entry->second);
+    }
+
+    std::vector<double (*)(const Solver&)> outputs;
+    for (const std::string& name : in.uq_outputs) {
+        auto entry = std::find_if(output_table.begin(), output_table.end(),
+            [&](const auto& e) { return e.first == name; });
+        if (entry == output_table.end())
+            throw std::runtime_error("UQ: unsupported output " + name);
+        outputs.push_back(entry->second);
+    }
+
+    std::vector<uq::Family> families;
+    for (const uq::Distribution& d : in.uq_distributions) families.push_back(d.family);
+
+    const uq::Grid grid = uq::smolyak(families, in.uq_level);
+
+    const int D = static_cast<int>(fields.size());
+    const int M = static_cast<int>(grid.points.size());
+    const int Q = static_cast<int>(outputs.size());
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+
+    std::vector<double> values(static_cast<std::size_t>(M) * Q);    // Output o of point m at m * Q + o
+    std::vector<int> steps(M, 0);
+    std::string error;
+
+    double start = omp_get_wtime();
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int m = 0; m < M; ++m) {
+
+        try {
+            Input run = in;
+            run.task_graph = false;
+            for (int q = 0; q < D; ++q) run.*fields[q] = in.uq_distributions[q].map(grid.points[m][q]);
+
+            Solver solver(run);
+
+            for (int n = 0; n <= time_steps; ++n) {
+                solver.step();
+                steps[m] = n + 1;
+                if (in.steady_tol > 0.0 && solver.step_change() <= in.steady_tol) break;
+            }
+
+            for (int o = 0; o < Q; ++o) values[static_cast<std::size_t>(m) * Q + o] = outputs[o](solver);
+        }
+        catch (const std::exception& e) {
+            #pragma omp critical
+            error = e.what();
+        }
+    }
+
+    if (!error.empty()) throw std::runtime_error(error);
+
+    double end = omp_get_wtime();
+
+    long long total_steps = 0;
+    for (int n : steps) total_steps += n;
+
+    fs::path outputDir = fs::path("output") / fs::path(inputFile).filename();
+    fs::create_directories(outputDir);
+
+    std::ofstream out(outputDir / in.uq_results_file);
+    out.precision(12);
+
+    out << "# " << M << " collocation points (Smolyak level " << in.uq_level << ")\n";
+    out << "# output mean std_dev";
+    for (const std::string& name : in.uq_parameters) out << " S_" << name;
+    for (const std::string& name : in.uq_parameters) out << " ST_" << name;
+    out << "\n";
+
+    printf("Execution time: %.6f s (%d collocation runs, %lld time steps, %d threads)\n",
+        end - start, M, total_steps, omp_get_max_threads());
+
+    for (int o = 0; o < Q; ++o) {
+
+        std::vector<double> y(M);
+        for (int m = 0; m < M; ++m) y[m] = values[static_cast<std::size_t>(m) * Q + o];
+
+        const uq::Expansion pce = uq::pseudospectral(grid, y);
+        const double mean = pce.mean();
+        const double std_dev = std::sqrt(pce.variance());
+        const std::vector<double> S = pce.first_order(D), ST = pce.total(D);
+
+        out << in.uq_outputs[o] << " " << mean << " " << std_dev;
+        for (double s : S) out << " " << s;
+        for (double s : ST) out << " " << s;
+        out << "\n";
+
+        printf("%-15s mean %.10g  std. dev. %.6g\n", in.uq_outputs[o].c_str(), mean, std_dev);
+        for (int q = 0; q < D; ++q)
+            printf("  %-15s  Sobol first order %.4f  total %.4f\n", in.uq_parameters[q].c_str(), S[q], ST[q]);
+    }
+
+    return 0;
+}
+
+#pragma endregion
+
+#pragma region fixed size
+
+// =======================================================================
+//                 FIXED-SIZE SOLVER FOR REAL-TIME USE
+// =======================================================================
+
+// The 1D solver with the cell count a compile-time constant, for small meshes
+// stepped against a deadline. Fields and coefficients are std::arrays held by
+// value, so every loop has constant bounds the compiler can unroll and
+// vectorize, and a step makes no heap allocation, no OpenMP call and no
+// indirection through vector headers. The discretization is BasicSolver's,
+// through the shared kernels; the iterations are those of
+// BasicSolver<double> with the default options: residuals checked every
+// iteration, no speculation, no lagged momentum coefficients, no passive
+// scalars. Sources are fixed per cell when the solver is built, and time
+// tables are not taken: boundary values are set by the caller between steps.
+template <int Cells>
+struct PisoFixed {
+
+    static_assert(Cells >= 4, "PisoFixed needs at least 4 cells");
+
+    static constexpr int N = Cells;         // Number of cells [-]
+
+    using Field = std::array<double, N>;
+
+    double L = 0.0;                         // Length of the domain [m]
+    double dz = 0.0;                        // Cell size [m]
+    double dt = 0.0;                        // Time step [s]
+
+    int    tot_outer_l = 0;                 // PISO outer iterations [-]
+    int    tot_inner_l = 0;                 // PISO inner iterations [-]
+    double outer_tol_l = 0.0;               // PISO outer tolerance [-]
+    double inner_tol_l = 0.0;               // PISO inner tolerance [-]
+    bool   rhie_chow_on_off_l = true;       // RhieChow interpolation on/off (1/0) [-]
+
+    double rho_l = 0.0;                     // Density [kg/m3]
+    double mu = 0.0;                        // Dynamic viscosity [kg/(m s)]
+    double k = 0.0;                         // Thermal diffusivity [m2/s]
+    double cp = 0.0;                        // Specific heat capacity at constant pressure [J/kgK]
+
+    // Boundary values may be set by the caller between steps
+    double u_inlet_value = 0.0;             // Inlet velocity [m/s]
+    double u_outlet_value = 0.0;            // Outlet velocity [m/s]
+    bool   u_inlet_bc = 0;                  // Inlet velocity BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   u_outlet_bc = 0;                 // Outlet velocity BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    double T_inlet_value = 0.0;             // Inlet temperature [K]
+    double T_outlet_value = 0.0;            // Outlet temperature [K]
+    bool   T_inlet_bc = 0;                  // Inlet temperature BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   T_outlet_bc = 0;                 // Outlet temperature BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    double p_inlet_value = 0.0;             // Inlet pressure [Pa]
+    double p_outlet_value = 0.0;            // Outlet pressure [Pa]
+    bool   p_inlet_bc = 0;                  // Inlet pressure BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   p_outlet_bc = 0;                 // Outlet pressure BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    const double K = 1e-8;
+    const double CF = 1e-4;
+
+    double time_total = 0.0;                // Simulated time [s]
+
+    Field S_m{}, S_h{};                     // Per-cell sources, zero outside the zones [kg/(m3 s)], [W/m3]
+
+    Field u_l{}, T_l{}, p_l{};              // Velocity [m/s], temperature [K], pressure [Pa]
+    Field u_l_old{}, T_l_old{}, p_l_old{};  // Previous time level
+    Field p_prime_l{};                      // Pressure correction [Pa]
+    std::array<double, N + 2> p_storage_l{};    // Padded pressure storage for RhieChow [Pa]
+    double* const p_padded_l = &p_storage_l[1]; // Real nodes of the padded pressure storage [Pa]
+
+    Field aLU{}, bLU{}, cLU{}, dLU{};       // Tridiagonal coefficients for velocity
+    Field aLT{}, bLT{}, cLT{}, dLT{};       // Tridiagonal coefficients for temperature
+    std::array<double, N + 1> u_face_l{};   // Face velocities of the energy assembly [m/s]
+
+    // Symmetric pressure-correction matrix, off-diagonal entry i coupling
+    // cells i and i + 1, and its LDL^T factors, formed once per outer iteration
+    struct {
+        Field diag{};
+        std::array<double, N - 1> off{};
+    } LP;
+    Field dLP{};
+    std::array<double, N - 1> LP_l{};
+    Field LP_inv_d{};
+
+    double continuity_residual = 1.0;
+    double momentum_residual = 1.0;
+    double energy_residual = 1.0;
+
+    long long total_outer_l = 0;            // Outer iterations over the whole run [-]
+    long long total_inner_l = 0;            // Inner iterations over the whole run [-]
+
+    explicit PisoFixed(const Input& in);
+
+    PisoFixed(const PisoFixed&) = delete;
+    PisoFixed& operator=(const PisoFixed&) = delete;
+
+    void step();
+
+    void factor_pressure_correction();
+    void solve_pressure_correction();
+    void correct_pressure();
+
+    // Calls row(i, S_m, S_h) for the interior cells, as BasicSolver does
+    template <typename Row>
+    void for_interior_cells(Row&& row) const {
+        for (int i = 1; i < N - 1; ++i) row(i, S_m[i], S_h[i]);
+    }
+
+    // Thomas algorithm in place: d holds the right-hand side on entry and the
+    // solution on exit. Same operations as tdma::solve.
+    static void solve(const Field& a, const Field& b, const Field& c, Field& d) {
+
+        Field c_star;
+
+        c_star[0] = c[0] / b[0];
+        d[0] = d[0] / b[0];
+
+        for (int i = 1; i < N; ++i) {
+            const double m = b[i] - a[i] * c_star[i - 1];
+            c_star[i] = c[i] / m;
+            d[i] = (d[i] - a[i] * d[i - 1]) / m;
+        }
+
+        for (int i = N - 2; i >= 0; --i)
+            d[i] = d[i] - c_star[i] * d[i + 1];
+    }
+};
+
+template <int Cells>
+PisoFixed<Cells>::PisoFixed(const Input& in) {
+
+    if (in.N != N)
+        throw std::runtime_error("Fixed size: input N does not match the instantiation");
+    if (!in.scalars.empty())
+        throw std::runtime_error("Fixed size: passive scalars are not supported");
+
+    for (const std::string* table : { &in.u_inlet_table, &in.u_outlet_table, &in.T_inlet_table, &in.T_outlet_table,
+        &in.p_inlet_table, &in.p_outlet_table, &in.S_m_table, &in.S_h_table })
+        if (!table->empty())
+            throw std::runtime_error("Fixed size: time tables are not supported, set boundary values between steps");
+
+    L = in.L;
+    dz = L / N;
+    dt = in.dt_user;
+
+    tot_outer_l = in.piso_outer_iter;
+    tot_inner_l = in.piso_inner_iter;
+    outer_tol_l = in.piso_outer_tol;
+    inner_tol_l = in.piso_inner_tol;
+    rhie_chow_on_off_l = in.rhie_chow_on_off_l;
+
+    rho_l = in.rho;
+    mu = in.mu;
+    k = in.k;
+    cp = in.cp;
+
+    u_inlet_value = in.u_inlet_value;
+    u_outlet_value = in.u_outlet_value;
+    u_inlet_bc = in.u_inlet_bc;
+    u_outlet_bc = in.u_outlet_bc;
+
+    T_inlet_value = in.T_inlet_value;
+    T_outlet_value = in.T_outlet_value;
+    T_inlet_bc = in.T_inlet_bc;
+    T_outlet_bc = in.T_outlet_bc;
+
+    p_inlet_value = in.p_inlet_value;
+    p_outlet_value = in.p_outlet_value;
+    p_inlet_bc = in.p_inlet_bc;
+    p_outlet_bc = in.p_outlet_bc;
+
+    u_l.fill(in.u_initial);
+    T_l.fill(in.T_initial);
+    p_l.fill(in.p_initial);
+
+    for (int i = 0; i < N; ++i) p_storage_l[i + 1] = p_l[i];
+    p_storage_l[0] = p_l[0];
+    p_storage_l[N + 1] = p_l[N - 1];
+
+    // The zones are only needed to fill the per-cell sources
+    std::vector<sources::Zone> zones;
+    Signals signals;
+    define_source_zones(in, N, dz, in.S_m_cell, in.S_h_cell, zones, signals);
+
+    for (const sources::Zone& zone : zones)
+        for (int i = std::max(zone.begin, 1); i < std::min(zone.end, N - 1); ++i) {
+            S_m[i] = zone.mass(i);
+            S_h[i] = zone.heat(i);
+        }
+
+    bLU.fill(rho_l * dz / dt + 2 * mu / dz);
+}
+
+template <int Cells>
+void PisoFixed<Cells>::step() {
+
+    time_total += dt;
+
+    u_l_old = u_l;
+    T_l_old = T_l;
+    p_l_old = p_l;
+
+    int outer_l = 0;
+
+    momentum_residual = 1.0;
+    energy_residual = 1.0;
+
+    while (outer_l < tot_outer_l && (momentum_residual > outer_tol_l || energy_residual > outer_tol_l)) {
+
+        // Momentum predictor
+        discretization::momentum_matrix(*this);
+        discretization::momentum_rhs(*this);
+        u_l = dLU;
+        solve(aLU, bLU, cLU, u_l);
+
+        // Energy
+        discretization::energy_system(*this);
+
+        const Field T_prev = T_l;
+        T_l = dLT;
+        solve(aLT, bLT, cLT, T_l);
+
+        energy_residual = 0.0;
+        for (int i = 0; i < N; ++i)
+            energy_residual = std::max(energy_residual, std::abs(T_l[i] - T_prev[i]));
+
+        // Pressure-velocity coupling, the matrix formed and factored once
+        int inner_l = 0;
+        continuity_residual = 1.0;
+
+        while (inner_l < tot_inner_l && continuity_residual > inner_tol_l) {
+
+            discretization::pressure_correction_system(*this, inner_l == 0);
+            if (inner_l == 0) factor_pressure_correction();
+
+            solve_pressure_correction();
+            correct_pressure();
+
+            for (int i = 1; i < N - 1; ++i)
+                u_l[i] -= discretization::velocity_correction(*this, i);
+
+            inner_l++;
+
+            continuity_residual = discretization::continuity_residual(*this);
+        }
+
+        momentum_residual = discretization::momentum_residual(*this);
+
+        outer_l++;
+        total_inner_l += inner_l;
+    }
+
+    total_outer_l += outer_l;
+}
+
+// LDL^T factors of the pressure-correction matrix. Same operations as tdma::factor.
+template <int Cells>
+void PisoFixed<Cells>::factor_pressure_correction() {
+
+    double d = LP.diag[0];
+    for (int i = 0; i < N - 1; ++i) {
+        LP_inv_d[i] = 1.0 / d;
+        LP_l[i] = LP.off[i] * LP_inv_d[i];
+        d = LP.diag[i + 1] - LP_l[i] * LP.off[i];
+    }
+    LP_inv_d[N - 1] = 1.0 / d;
+}
+
+// Pressure correction from the factors and dLP. Same operations as tdma::solve.
+template <int Cells>
+void PisoFixed<Cells>::solve_pressure_correction() {
+
+    p_prime_l = dLP;
+    for (int i = 1; i < N; ++i)
+        p_prime_l[i] = p_prime_l[i] - LP_l[i - 1] * p_prime_l[i - 1];
+
+    p_prime_l[N - 1] = p_prime_l[N - 1] * LP_inv_d[N - 1];
+    for (int i = N - 2; i >= 0; --i)
+        p_prime_l[i] = p_prime_l[i] * LP_inv_d[i] - LP_l[i] * p_prime_l[i + 1];
+}
+
+template <int Cells>
+void PisoFixed<Cells>::correct_pressure() {
+
+    for (int i = 0; i < N; ++i) {
+        p_l[i] += p_prime_l[i];
+        p_storage_l[i + 1] = p_l[i];
+    }
+
+    discretization::pressure_boundaries(*this);
+}
+
+// Runs the case on the instantiation for its cell count and reports the
+// latency of the individual steps. Setup and output stay outside the timed
+// region; the step times go into storage reserved up front.
+template <int N>
+int run_fixed_size_pass(const Input& in, const std::string& inputFile) {
+
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+    const int print_every = std::max(time_steps / in.number_output, 1);
+
+    auto solver = std::make_unique<PisoFixed<N>>(in);
+
+    fs::path outputDir = fs::path("output") / fs::path(inputFile).filename();
+    fs::create_directories(outputDir);
+
+    std::ofstream v_out(outputDir / in.velocity_file);
+    std::ofstream p_out(outputDir / in.pressure_file);
+    std::ofstream T_out(outputDir / in.temperature_file);
+
+    auto write = [](const std::array<double, N>& field, std::ofstream& out) {
+        for (int i = 0; i < N; ++i) out << field[i] << ", ";
+        out << "\n";
+    };
+
+    std::vector<double> latency;            // Step times [us]
+    latency.reserve(time_steps + 1);
+
+    double start = omp_get_wtime();
+
+    for (int n = 0; n <= time_steps; ++n) {
+
+        const auto t0 = std::chrono::steady_clock::now();
+        solver->step();
+        const auto t1 = std::chrono::steady_clock::now();
+
+        latency.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+
+        if (n % print_every == 0) {
+            write(solver->u_l, v_out);
+            write(solver->p_l, p_out);
+            write(solver->T_l, T_out);
+        }
+    }
+
+    double end = omp_get_wtime();
+
+    std::sort(latency.begin(), latency.end());
+    auto percentile = [&](double q) {
+        return latency[static_cast<std::size_t>(q * (latency.size() - 1) + 0.5)];
+    };
+
+    printf("Execution time: %.6f s (fixed size, N = %d)\n", end - start, N);
+    printf("PISO iterations: %lld outer, %lld inner\n", solver->total_outer_l, solver->total_inner_l);
+    printf("Step latency: p50 %.2f us, p99 %.2f us, max %.2f us over %zu steps\n",
+        percentile(0.5), percentile(0.99), latency.back(), latency.size());
+
+    return 0;
+}
+
+// The cell count is a compile-time constant, so runs are dispatched to the
+// instantiation matching N
+int run_fixed_size(const Input& in, const std::string& inputFile) {
+
+    switch (in.N) {
+    case 16: return run_fixed_size_pass<16>(in, inputFile);
+    case 24: return run_fixed_size_pass<24>(in, inputFile);
+    case 32: return run_fixed_size_pass<32>(in, inputFile);
+    case 40: return run_fixed_size_pass<40>(in, inputFile);
+    case 48: return run_fixed_size_pass<48>(in, inputFile);
+    case 56: return run_fixed_size_pass<56>(in, inputFile);
+    case 64: return run_fixed_size_pass<64>(in, inputFile);
+    default:
+        throw std::runtime_error("Fixed size: N must be one of 16, 24, 32, 40, 48, 56, 64");
+    }
+}
+
+#pragma endregion
+
+#pragma region co-simulation
+
+// =======================================================================
+//                   RESUMABLE STEPPING FOR CO-SIMULATION
+// =======================================================================
+
+// Time loop of a solver as a resumable function: resume() runs the solver to
+// its next yield point, the end of a time step or, with yield_outer, of every
+// outer iteration, and returns there. A co-simulation master can interleave
+// many instances on one thread and read the fields and residuals of the
+// solver in between. The resume point is all the frame there is, the solver
+// holding the rest, so a resume is a switch and allocates nothing: the frame
+// a C++20 coroutine would keep, written out for the C++17 build. Model is the
+// stepped solver, anything with the begin_step, outer_iteration_due,
+// outer_iteration and end_step of BasicSolver.
+template <typename Model>
+class BasicStepper {
+public:
+    enum class Yield { outer_iteration, time_step, finished };
+
+    BasicStepper(Model& solver, int time_steps, bool yield_outer)
+        : solver_(&solver), time_steps_(time_steps), yield_outer_(yield_outer) {}
+
+    Yield resume() {
+
+        switch (state_) {
+
+        case State::between_steps:
+
+            if (step_ > time_steps_) return Yield::finished;
+
+            solver_->begin_step();
+            state_ = State::in_step;
+            [[fallthrough]];
+
+        case State::in_step:
+
+            while (solver_->outer_iteration_due()) {
+                solver_->outer_iteration();
+                if (yield_outer_) return Yield::outer_iteration;
+            }
+
+            solver_->end_step();
+            state_ = State::between_steps;
+            ++step_;
+            return Yield::time_step;
+        }
+
+        return Yield::finished;
+    }
+
+    const Model& solver() const { return *solver_; }
+    int steps_done() const { return step_; }
+
+private:
+    enum class State { between_steps, in_step };
+
+    Model* solver_;
+    int time_steps_;
+    bool yield_outer_;
+
+    State state_ = State::between_steps;
+    int step_ = 0;
+};
+
+using Stepper = BasicStepper<Solver>;
+
+// Stand-in for a solver that does no work, so that stepping it times the
+// resume machinery alone
+struct IdleModel {
+    int outer = 0;
+    int outer_iterations = 0;
+
+    void begin_step() { outer = 0; }
+    bool outer_iteration_due() const { return outer < outer_iterations; }
+    void outer_iteration() { ++outer; }
+    void end_step() {}
+};
+
+// Steps `steppers` round robin, each from yield to yield, until all are
+// finished. Returns the number of resumes that did not find their stepper
+// finished.
+template <typename Model>
+long long interleave(std::vector<BasicStepper<Model>>& steppers) {
+
+    long long resumes = 0;
+    int running = static_cast<int>(steppers.size());
+
+    while (running > 0) {
+        running = 0;
+        for (BasicStepper<Model>& stepper : steppers) {
+            if (stepper.resume() == BasicStepper<Model>::Yield::finished) continue;
+            ++running;
+            ++resumes;
+        }
+    }
+
+    return resumes;
+}
+
+// Runs cosim_instances copies of the case twice on one thread: each advanced
+// by plain step() calls, then all interleaved through their steppers. The
+// fields of the two runs must agree exactly. The cost of a resume is timed
+// on idle models with the same number of yields.
+int run_cosimulation(const Input& in, const std::string& inputFile) {
+
+    Input single = in;
+    single.task_graph = false;
+
+    const int instances = in.cosim_instances;
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+
+    std::vector<std::unique_ptr<Solver>> direct, interleaved;
+    for (int k = 0; k < instances; ++k) {
+        direct.push_back(std::make_unique<Solver>(single));
+        interleaved.push_back(std::make_unique<Solver>(single));
+    }
+
+    double start = omp_get_wtime();
+
+    for (int n = 0; n <= time_steps; ++n)
+        for (auto& solver : direct) solver->step();
+
+    const double direct_time = omp_get_wtime() - start;
+
+    std::vector<Stepper> steppers;
+    for (auto& solver : interleaved) steppers.emplace_back(*solver, time_steps, in.cosim_yield_outer);
+
+    start = omp_get_wtime();
+
+    const long long resumes = interleave(steppers);
+
+    const double interleaved_time = omp_get_wtime() - start;
+
+    // Idle models with the outer iterations the solvers took on average
+    std::vector<IdleModel> idle(instances);
+    for (IdleModel& model : idle)
+        model.outer_iterations = static_cast<int>(interleaved[0]->total_outer_l / (time_steps + 1));
+
+    std::vector<BasicStepper<IdleModel>> idle_steppers;
+    for (IdleModel& model : idle) idle_steppers.emplace_back(model, time_steps, in.cosim_yield_outer);
+
+    start = omp_get_wtime();
+
+    const long long idle_resumes = interleave(idle_steppers);
+
+    const double idle_time = omp_get_wtime() - start;
+
+    double difference = 0.0;
+    for (int k = 0; k < instances; ++k)
+        for (int i = 0; i < in.N; ++i) {
+            difference = std::max(difference, std::abs(direct[k]->u_l[i] - interleaved[k]->u_l[i]));
+            difference = std::max(difference, std::abs(direct[k]->p_l[i] - interleaved[k]->p_l[i]));
+            difference = std::max(difference, std::abs(direct[k]->T_l[i] - interleaved[k]->T_l[i]));
+        }
+
+    printf("Co-simulation of %s: %d instances, %lld resumes (yield after every %s)\n",
+        fs::path(inputFile).filename().string().c_str(), instances, resumes,
+        in.cosim_yield_outer ? "outer iteration" : "time step");
+    printf("Execution time: %.6f s direct, %.6f s interleaved\n", direct_time, interleaved_time);
+    printf("Resume overhead: %.2f ns per resume (%lld resumes of idle models)\n",
+        1e9 * idle_time / std::max(idle_resumes, 1LL), idle_resumes);
+    printf("Largest field difference to direct stepping: %g\n", difference);
+
+    return 0;
+}
+
+#pragma endregion
+
+#pragma region live fields
+
+// =======================================================================
+//                          LIVE FIELD WATCHER
+// =======================================================================
+
+// Reader of the live fields another run of the same case publishes: prints
+// time, residuals and the outlet values of each new snapshot, polling a few
+// times a second, until the run reports it is finished. Waits a while for
+// the run to create its segment.
+int run_live_watch(const Input& in) {
+
+    std::unique_ptr<live::Reader> reader;
+
+    for (int attempt = 0; !reader; ++attempt) {
+        try {
+            reader = std::make_unique<live::Reader>(in.live_fields);
+        }
+        catch (const std::runtime_error&) {
+            if (attempt == 100) throw;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+
+    live::Snapshot snapshot;
+    long long last_step = -1;
+
+    while (true) {
+
+        if (reader->read(snapshot) && snapshot.step != last_step) {
+
+            last_step = snapshot.step;
+            const int n = reader->cells();
+
+            printf("step %lld  t = %.6f s  residuals %.3e %.3e %.3e  outlet u = %.6g m/s  p = %.6g Pa  T = %.6g K\n",
+                snapshot.step, snapshot.time, snapshot.residuals[0], snapshot.residuals[1], snapshot.residuals[2],
+                snapshot.u[n - 1], snapshot.p[n - 1], snapshot.T[n - 1]);
+        }
+
+        if (snapshot.finished) break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    return 0;
+}
+
+#pragma endregion
+
+#pragma region coupling
+
+// =======================================================================
+//                 BOUNDARY COUPLING OVER A LOCAL SOCKET
+// =======================================================================
+
+// Round trips of `pings` single ping records, then the same number sent in
+// batches of 64 and answered in kind, before a coupled run starts
+void coupling_ping_benchmark(coupling::Channel& channel, int pings) {
+
+    if (pings <= 0) return;
+
+    std::vector<double> rtt;
+    rtt.reserve(pings);
+
+    coupling::Record ping, pong;
+
+    for (int k = 0; k < pings; ++k) {
+        ping.step = k;
+        const auto t0 = std::chrono::steady_clock::now();
+        channel.send(ping);
+        if (!channel.receive(pong) || pong.step != k)
+            throw std::runtime_error("Coupling: ping not echoed");
+        rtt.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+    }
+
+    std::vector<coupling::Record> batch(64);
+    const auto t0 = std::chrono::steady_clock::now();
+
+    for (int sent = 0; sent < pings; sent += static_cast<int>(batch.size())) {
+        const int count = std::min(static_cast<int>(batch.size()), pings - sent);
+        channel.send(batch.data(), count);
+        for (int k = 0; k < count; ++k)
+            if (!channel.receive(pong)) throw std::runtime_error("Coupling: ping not echoed");
+    }
+
+    const double batched = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / pings;
+
+    std::sort(rtt.begin(), rtt.end());
+    auto percentile = [&](double q) { return rtt[static_cast<std::size_t>(q * (rtt.size() - 1) + 0.5)]; };
+
+    printf("Coupling round trip: p50 %.2f us, p99 %.2f us, max %.2f us over %d pings; %.3f us per record in batches of %zu\n",
+        percentile(0.5), percentile(0.99), rtt.back(), pings, batched, batch.size());
+}
+
+// Stand-in for the external process of a coupled run: connects to the
+// solver, echoes pings and answers every outflow record with inflow values
+// for the same step, from a closed loop returning the outlet through a heat
+// exchanger of effectiveness 1/2 to the nominal inlet temperature. Velocity
+// and outlet pressure stay at their input values. Everything already received
+// is answered in one write.
+int run_coupling_client(const Input& in) {
+
+    coupling::Client client(in.coupling_socket);
+
+    std::vector<coupling::Record> replies;
+    replies.reserve(64);
+
+    coupling::Record record;
+    long long answered = 0;
+
+    while (client.receive(record) && record.type != coupling::Type::end) {
+
+        if (record.type == coupling::Type::outflow) {
+
+            const double T_outlet = record.values[coupling::T_outlet];
+
+            record.type = coupling::Type::inflow;
+            record.values[coupling::u_inlet] = in.u_inlet_value;
+            record.values[coupling::T_inlet] = in.T_inlet_value + 0.5 * (T_outlet - in.T_inlet_value);
+            record.values[coupling::p_outlet] = in.p_outlet_value;
+            record.values[3] = record.values[4] = 0.0;
+
+            ++answered;
+        }
+
+        replies.push_back(record);
+
+        if (client.buffered() == 0) {
+            client.send(replies.data(), replies.size());
+            replies.clear();
+        }
+    }
+
+    printf("Coupling client: answered %lld time steps\n", answered);
+
+    return 0;
+}
+
+#pragma endregion
+
+#pragma region daemon
+
+// =======================================================================
+//                     SOLVER DAEMON WITH A SPOOL QUEUE
+// =======================================================================
+
+// Spool layout: jobs are case files placed in incoming/ (written elsewhere,
+// or under a name starting with '.', and renamed in, so they appear whole).
+// A job is claimed by renaming it to running/, which only one daemon can
+// win. Results go to done/<job>/ with the case file, or the case file to
+// failed/; status/<job> holds the state as "key = value" lines. Results and
+// status files are written under temporary names and renamed into place, so
+// a reader never sees them half written. Jobs override the keys of the
+// daemon's own input file.
+struct Spool {
+    fs::path incoming, running, done, failed, status;
+
+    explicit Spool(const fs::path& root)
+        : incoming(root / "incoming"), running(root / "running"), done(root / "done"),
+          failed(root / "failed"), status(root / "status")
+    {
+        for (const fs::path* dir : { &incoming, &running, &done, &failed, &status })
+            fs::create_directories(*dir);
+    }
+};
+
+// Writes `text` to `path` through a temporary file renamed over it
+void write_atomically(const fs::path& path, const std::string& text) {
+
+    const fs::path tmp = path.parent_path() / ("." + path.filename().string() + ".tmp");
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out << text;
+        if (!out) throw std::runtime_error("Daemon: cannot write " + tmp.string());
+    }
+    fs::rename(tmp, path);
+}
+
+// Jobs claimed and waiting for a worker
+class JobQueue {
+public:
+    void push(std::string job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        ready_.notify_one();
+    }
+
+    // Next job, waiting for one; false once closed and drained
+    bool pop(std::string& job) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return closed_ || !jobs_.empty(); });
+        if (jobs_.empty()) return false;
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        ready_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::string> jobs_;
+    bool closed_ = false;
+};
+
+// What a worker keeps between jobs: the solver, reset for every job so its
+// fields keep their storage while the cell count stays the same, and the
+// output text buffers with their capacity
+struct WorkerArena {
+    std::optional<Solver> solver;
+    std::array<std::string, 3> text;                // Velocity, pressure, temperature
+    std::vector<std::string> scalar_text;
+};
+
+// Appends one output line of a field, formatted as the plain run writes it
+void append_line(std::string& text, const std::vector<double>& field) {
+
+    char number[32];
+    for (double v : field) {
+        const int length = std::snprintf(number, sizeof(number), "%g, ", v);
+        text.append(number, length);
+    }
+    text += '\n';
+}
+
+// Runs a 1D job in the worker's arena and writes its output files to `dir`.
+// Returns the status lines of a finished job.
+std::string run_job(const Input& in, WorkerArena& arena, const fs::path& dir) {
+
+    if (in.Nr > 1 || in.rom || !in.sensitivity_parameters.empty() || !in.adjoint_objective.empty() ||
+        !in.uq_parameters.empty() || in.fixed_size || in.cosim_instances > 0 || !in.coupling_socket.empty() ||
+        in.wall_time_budget > 0.0 || in.dmd_every > 0 || in.statistics || !in.live_fields.empty())
+        throw std::runtime_error("Daemon: jobs must be plain 1D runs");
+
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+    const int print_every = std::max(time_steps / in.number_output, 1);
+
+    const double start = omp_get_wtime();
+
+    if (arena.solver) arena.solver->reset(in);
+    else arena.solver.emplace(in);
+    Solver& solver = *arena.solver;
+
+    for (std::string& text : arena.text) text.clear();
+    arena.scalar_text.resize(in.scalars.size());
+    for (std::string& text : arena.scalar_text) text.clear();
+
+    int steps = 0;
+
+    for (int n = 0; n <= time_steps; ++n) {
+
+        solver.step();
+        ++steps;
+
+        const bool steady = in.steady_tol > 0.0 && solver.step_change() <= in.steady_tol;
+
+        if (n % print_every == 0 || steady) {
+            append_line(arena.text[0], solver.u_l);
+            append_line(arena.text[1], solver.p_l);
+            append_line(arena.text[2], solver.T_l);
+            for (std::size_t s = 0; s < in.scalars.size(); ++s)
+                append_line(arena.scalar_text[s], solver.scalars[s].phi);
+        }
+
+        if (steady) break;
+    }
+
+    const double elapsed = omp_get_wtime() - start;
+
+    fs::create_directories(dir);
+    write_atomically(dir / in.velocity_file, arena.text[0]);
+    write_atomically(dir / in.pressure_file, arena.text[1]);
+    write_atomically(dir / in.temperature_file, arena.text[2]);
+    for (std::size_t s = 0; s < in.scalars.size(); ++s)
+        write_atomically(dir / in.scalars[s].file, arena.scalar_text[s]);
+
+    std::ostringstream status;
+    status << "state = done\n"
+        << "time_steps = " << steps << "\n"
+        << "outer_iterations = " << solver.total_outer_l << "\n"
+        << "inner_iterations = " << solver.total_inner_l << "\n"
+        << "execution_time = " << elapsed << "\n";
+    return status.str();
+}
+
+// Watches the spool of the daemon's input file and runs its jobs on
+// daemon_workers threads until a file named "stop" appears in the spool, or
+// nothing has come in for daemon_idle_exit seconds
+int run_daemon(const Input& in, const std::string& inputFile) {
+
+    const Spool spool(in.daemon_spool);
+    const fs::path stop = fs::path(in.daemon_spool) / "stop";
+
+    JobQueue queue;
+    std::atomic<int> busy{ 0 };
+
+    auto worker = [&]() {
+
+        WorkerArena arena;
+        std::string job;
+
+        while (queue.pop(job)) {
+
+            const fs::path claimed = spool.running / job;
+            const fs::path results = spool.done / job;
+            const fs::path staging = spool.done / ("." + job + ".tmp");
+
+            try {
+                Input job_in = readInput(claimed.string(), inputFile);
+
+                fs::remove_all(staging);
+                const std::string status = run_job(job_in, arena, staging);
+
+                fs::rename(claimed, staging / job);
+                fs::remove_all(results);
+                fs::rename(staging, results);
+
+                write_atomically(spool.status / job, status);
+                printf("Daemon: %s done\n", job.c_str());
+            }
+            catch (const std::exception& e) {
+
+                std::error_code ec;
+                fs::remove_all(staging, ec);
+                fs::rename(claimed, spool.failed / job, ec);
+
+                write_atomically(spool.status / job, std::string("state = failed\nerror = ") + e.what() + "\n");
+                printf("Daemon: %s failed: %s\n", job.c_str(), e.what());
+            }
+
+            --busy;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < std::max(in.daemon_workers, 1); ++w) workers.emplace_back(worker);
+
+    printf("Daemon: watching %s with %zu workers\n", spool.incoming.string().c_str(), workers.size());
+
+    double last_job = omp_get_wtime();
+    std::vector<std::string> found;
+
+    while (!fs::exists(stop)) {
+
+        found.clear();
+        for (const auto& entry : fs::directory_iterator(spool.incoming)) {
+            const std::string name = entry.path().filename().string();
+            if (entry.is_regular_file() && name[0] != '.') found.push_back(name);
+        }
+        std::sort(found.begin(), found.end());
+
+        for (const std::string& job : found) {
+
+            // Another daemon may have claimed the job first
+            std::error_code ec;
+            fs::rename(spool.incoming / job, spool.running / job, ec);
+            if (ec) continue;
+
+            write_atomically(spool.status / job, "state = running\n");
+
+            ++busy;
+            queue.push(job);
+        }
+
+        if (!found.empty() || busy > 0) last_job = omp_get_wtime();
+        else if (in.daemon_idle_exit > 0.0 && omp_get_wtime() - last_job > in.daemon_idle_exit) break;
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(in.daemon_poll));
+    }
+
+    queue.close();
+    for (std::thread& t : workers) t.join();
+
+    printf("Daemon: stopped\n");
+
+    return 0;
+}
+
+#pragma endregion
+
+#pragma region wall-time budget
+
+// =======================================================================
+// Runs the case as far as the plain run goes, time_steps + 1 steps of
+// dt_user, within wall_time_budget. After every step the measured wall time
+// per step sets the time step the remaining simulated time needs, kept
+// within [wall_time_dt_min, wall_time_dt_max]. A run that is behind even at
+// the largest step loosens the outer tolerance a decade at a time up to
+// wall_time_tol_max, then writes fewer outputs, down to
+// wall_time_output_min; a run ahead again undoes those in reverse order.
+// Outputs are due at the simulated times the plain run writes at, so a run
+// held at dt_user writes what the plain run does.
+int run_wall_time_budget(const Input& in, const std::string& inputFile) {
+
+    if (in.dmd_every > 0 || in.statistics || !in.coupling_socket.empty() || !in.live_fields.empty())
+        throw std::runtime_error("Wall time budget: DMD, statistics, coupling and live fields need fixed time steps");
+
+    const int N = in.N;
+    const double budget = in.wall_time_budget * (1.0 - in.wall_time_margin);
+    const double dt_min = in.wall_time_dt_min;
+    const double dt_max = in.wall_time_dt_max;
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+    const int print_every = std::max(time_steps / std::max(in.number_output, 1), 1);
+    const int marks = time_steps / print_every;                     // Last output mark [-]
+    const int outputs_min = std::clamp(in.wall_time_output_min, 1, marks + 1);
+    const double end_time = (time_steps + 1) * in.dt_user;
+
+    Solver solver(in);
+
+    fs::path outputDir = fs::path("output") / fs::path(inputFile).filename();
+    fs::create_directories(outputDir);
+
+    std::ofstream v_out(outputDir / in.velocity_file);
+    std::ofstream p_out(outputDir / in.pressure_file);
+    std::ofstream T_out(outputDir / in.temperature_file);
+
+    std::vector<std::ofstream> scalar_out;
+    for (const ScalarInput& sc : in.scalars)
+        scalar_out.emplace_back(outputDir / sc.file);
+
+    auto write = [N](const std::vector<double>& field, std::ofstream& out) {
+        for (int i = 0; i < N; ++i) out << field[i] << ", ";
+        out << "\n";
+    };
+
+    double dt = std::clamp(in.dt_user, dt_min, dt_max);
+    double outer_tol = in.piso_outer_tol;
+    int stride = 1;                         // Output marks per output written [-]
+    int next_mark = 0;                      // Next output mark, after step next_mark * print_every of the plain run [-]
+    int written = 0;
+
+    double cost = 0.0;                      // Wall time per step, exponentially averaged [s]
+
+    // Accuracy reached: time steps and tolerances used, the end-of-step
+    // residuals, and the first-order local error of u and T in each step
+    // after the first, estimated from the change of the step-to-step
+    // difference. Pressure has no time derivative of its own.
+    long long steps = 0, unconverged = 0;
+    double dt_low = dt, dt_high = dt, tol_high = outer_tol;
+    double worst_residual = 0.0, temporal_error = 0.0, worst_local = 0.0, dt_before = 0.0;
+    std::vector<double> delta(2 * N, 0.0);
+
+    auto local_error = [&](double ratio) {
+
+        const std::array<std::pair<const std::vector<double>*, const std::vector<double>*>, 2> fields = { {
+            { &solver.u_l, &solver.u_l_old }, { &solver.T_l, &solver.T_l_old } } };
+
+        double e = 0.0;
+        int offset = 0;
+
+        for (const auto& [field, field_old] : fields) {
+
+            const std::vector<double>& x = *field;
+            const std::vector<double>& x_old = *field_old;
+
+            double c = 0.0, size = 1e-30;
+            for (int i = 0; i < N; ++i) {
+                const double d = x[i] - x_old[i];
+                c = std::max(c, std::abs(d - ratio * delta[offset + i]));
+                size = std::max(size, std::abs(x[i]));
+                delta[offset + i] = d;
+            }
+
+            e = std::max(e, 0.5 * c / size);
+            offset += N;
+        }
+
+        return e;
+    };
+
+    // Marks passed by a step are written once; thinned runs write every
+    // stride-th mark and the last one
+    auto output_due = [&]() {
+
+        bool due = false;
+        while (next_mark <= marks && (next_mark * print_every + 1) * in.dt_user <= solver.time_total + 1e-9 * dt) {
+            if (next_mark % stride == 0 || next_mark == marks) due = true;
+            ++next_mark;
+        }
+        return due;
+    };
+
+    const double start = omp_get_wtime();
+
+    while (end_time - solver.time_total > 1e-9 * dt) {
+
+        const double step_start = omp_get_wtime();
+
+        // The last step lands on the end time, a remainder of up to 1.5 dt
+        // taking two equal steps. Rounding in the accumulated time does not
+        // change dt.
+        const double left = end_time - solver.time_total;
+        double dt_step = dt;
+        if (left < (1.0 - 1e-9) * dt) dt_step = left;
+        else if (left > (1.0 + 1e-9) * dt && left < 1.5 * dt) dt_step = 0.5 * left;
+        solver.set_time_step(dt_step);
+
+        solver.step();
+        ++steps;
+
+        const double residual = std::max(solver.momentum_residual, solver.energy_residual);
+        worst_residual = std::max(worst_residual, residual);
+        if (residual > outer_tol) ++unconverged;
+
+        const double e = local_error(steps > 1 ? dt_step / dt_before : 0.0);
+        if (steps > 1) {
+            temporal_error += e;
+            worst_local = std::max(worst_local, e);
+        }
+        dt_before = dt_step;
+        dt_low = std::min(dt_low, dt_step);
+        dt_high = std::max(dt_high, dt_step);
+
+        const bool steady = in.steady_tol > 0.0 && solver.step_change() <= in.steady_tol;
+
+        if (output_due() || steady) {
+
+            write(solver.u_l, v_out);
+            write(solver.p_l, p_out);
+            write(solver.T_l, T_out);
+            for (std::size_t s = 0; s < scalar_out.size(); ++s)
+                write(solver.scalars[s].phi, scalar_out[s]);
+            ++written;
+        }
+
+        if (steady) break;
+
+        // ===============================================================
+        // CONTROL
+        // ===============================================================
+
+        const double now = omp_get_wtime();
+        cost = steps == 1 ? now - step_start : 0.8 * cost + 0.2 * (now - step_start);
+
+        const double wall_left = budget - (now - start);
+        const double time_left = end_time - solver.time_total;
+        const double affordable = wall_left / cost;                 // Steps left in the budget [-]
+        const double dt_needed = affordable > 1.0 ? time_left / affordable : dt_max * 2.0;
+
+        if (dt_needed > dt_max && dt >= dt_max) {
+
+            if (outer_tol < in.wall_time_tol_max) outer_tol = std::min(10.0 * outer_tol, in.wall_time_tol_max);
+            else if (marks / (2 * stride) + 1 >= outputs_min) stride *= 2;
+        }
+        else if (dt_needed < 0.25 * dt_max) {
+
+            if (stride > 1) stride /= 2;
+            else if (outer_tol > in.piso_outer_tol) outer_tol = std::max(0.1 * outer_tol, in.piso_outer_tol);
+        }
+
+        // The inner tolerance follows the outer one, unless that is zero to
+        // force a fixed number of outer iterations
+        const double inner_tol = in.piso_outer_tol > 0.0 ? in.piso_inner_tol * outer_tol / in.piso_outer_tol : in.piso_inner_tol;
+        solver.set_tolerances(outer_tol, inner_tol, in.piso_inner_tol_max);
+        tol_high = std::max(tol_high, outer_tol);
+
+        // At most a factor of two per step, and none within 10 %
+        const double dt_target = std::clamp(dt_needed, std::max(dt_min, 0.5 * dt), std::min(dt_max, 2.0 * dt));
+        if (std::abs(dt_target / dt - 1.0) > 0.1) dt = dt_target;
+    }
+
+    const double elapsed = omp_get_wtime() - start;
+
+    printf("Execution time: %.6f s of a %.6f s budget%s\n", elapsed, in.wall_time_budget,
+        elapsed > in.wall_time_budget ? " (exceeded)" : "");
+    printf("PISO iterations: %lld outer, %lld inner, %lld residual evaluations\n",
+        solver.total_outer_l, solver.total_inner_l, solver.residual_checks_l);
+    printf("Time steps: %lld to t = %g s, dt %.3e to %.3e s (mean %.3e, dt_user %.3e)\n",
+        steps, solver.time_total, dt_low, dt_high, solver.time_total / std::max(steps, 1LL), in.dt_user);
+    printf("Outer tolerance: %.1e to %.1e; %lld steps ended above the one in force, largest end-of-step residual %.2e\n",
+        in.piso_outer_tol, tol_high, unconverged, worst_residual);
+    printf("Estimated temporal error of u and T: %.3e, largest per step %.3e (relative to the field magnitudes)\n",
+        temporal_error, worst_local);
+    printf("Outputs written: %d of %d\n", written, marks + 1);
+
+    return 0;
+}
+
+#pragma endregion
+
+// =======================================================================
+//                                MAIN
+// =======================================================================
+
+int main() {
+
+#ifndef NDEBUG
+    tdma::check_banded_solves();
+#endif
+
+    std::string inputFile = chooseInputFile("input");
+    std::cout << "Using input file: " << inputFile << std::endl;
+
+    Input in = readInput(inputFile);
+
+    // The speculative sections are nested inside the pressure-velocity branch
+    // of the step. Nesting is process-wide, so it is enabled once here for
+    // the case that asks for it rather than by every solver.
+    if (in.piso_speculative && in.task_graph) omp_set_max_active_levels(2);
+
+    if (in.live_fields_watch) return run_live_watch(in);
+
+    if (in.coupling_client && !in.coupling_socket.empty()) return run_coupling_client(in);
+
+    if (!in.daemon_spool.empty()) return run_daemon(in, inputFile);
+
+    // Axisymmetric cases run their own time loop; Nr = 1 is the 1D solver below
+    if (in.Nr > 1) return run_axisymmetric(in, inputFile);
+
+    if (in.rom) return run_reduced_order(in, inputFile);
+
+    if (!in.sensitivity_parameters.empty()) return run_sensitivity(in, inputFile);
+
+    if (!in.adjoint_objective.empty()) return run_adjoint(in, inputFile);
+
+    if (!in.uq_parameters.empty()) return run_uncertainty(in, inputFile);
+
+    if (in.fixed_size) return run_fixed_size(in, inputFile);
+
+    if (in.cosim_instances > 0) return run_cosimulation(in, inputFile);
+
+    if (in.wall_time_budget > 0.0) return run_wall_time_budget(in, inputFile);
+
+    const int    N = in.N;                                              // Number of cells [-]
+    const double dt_user = in.dt_user;                                  // User-defined time step [s]
+    const double simulation_time = in.simulation_time;                  // Total simulation time [s]
+    const int time_steps = static_cast<int>(simulation_time / dt_user); // Number of time steps [-]
+
+    const int number_output = in.number_output;                         // Number of outputs [-]
+    const int print_every = time_steps / number_output;                 // Print output every n time steps [-]
+
+    Solver solver(in);
+
+    fs::path inputPath(inputFile);
+    std::string caseName = inputPath.filename().string();
+    fs::path outputDir = fs::path("output") / caseName;
+    fs::create_directories(outputDir);
+
+    std::ofstream v_out(outputDir / in.velocity_file);              // Velocity output file
+    std::ofstream p_out(outputDir / in.pressure_file);              // Pressure output file
+    std::ofstream T_out(outputDir / in.temperature_file);           // Temperature output file
+
+    std::vector<std::ofstream> scalar_out;                          // Passive scalar output files
+    for (const ScalarInput& sc : in.scalars)
+        scalar_out.emplace_back(outputDir / sc.file);
+
+    // Output formatting runs on its own thread from a copy of the fields,
+    // overlapping the next time steps. Only one write is in flight at a time.
+    std::vector<double> u_snapshot, p_snapshot, T_snapshot;
+    std::vector<std::vector<double>> scalar_snapshot(in.scalars.size());
+    std::future<void> pending_output;
+
+    // DMD acceleration: u, p and T, each scaled by its magnitude at the start
+    // of the window, are extrapolated to their limit every dmd_every steps.
+    // The step after a jump must change the fields less than the one before
+    // it, otherwise the jump is undone.
+    dmd::Extrapolator extrapolator(in.dmd_window, in.dmd_rank_tol);
+    std::array<double, 3> dmd_scale = { 1.0, 1.0, 1.0 };
+    std::vector<double> dmd_state, u_saved, p_saved, T_saved;
+    int steps_since_jump = 0;
+    bool verifying = false;
+    double change_before_jump = 0.0;
+    long long jumps_accepted = 0, jumps_rejected = 0;
+
+    auto magnitude = [](const std::vector<double>& x) {
+        double m = 0.0;
+        for (double v : x) m = std::max(m, std::abs(v));
+        return m > 0.0 ? m : 1.0;
+    };
+
+    // Latest fields for readers on the same host, through shared memory
+    std::unique_ptr<live::Publisher> live_out;
+    if (!in.live_fields.empty()) live_out = std::make_unique<live::Publisher>(in.live_fields, N);
+
+    // Boundary values exchanged with an external process every time step.
+    // Step n takes the answer to the outflow of step n - 1 - coupling_lag, so
+    // with a lag the round trip overlaps the intervening steps.
+    std::unique_ptr<coupling::Server> coupler;
+    std::vector<double> coupling_wait;                              // Time blocked on every answer [us]
+
+    if (!in.coupling_socket.empty()) {
+
+        printf("Waiting for the coupling client on %s\n", in.coupling_socket.c_str());
+        coupler = std::make_unique<coupling::Server>(in.coupling_socket);
+
+        coupling_ping_benchmark(*coupler, in.coupling_ping);
+        coupling_wait.reserve(time_steps + 1);
+    }
+
+    int steady_step = -1;
+    double start = omp_get_wtime();
+
+    // Time-stepping loop
+    for (int n = 0; n <= time_steps; ++n) {
+
+        if (coupler && n - 1 - in.coupling_lag >= 0) {
+
+            coupling::Record inflow;
+
+            const auto t0 = std::chrono::steady_clock::now();
+            if (!coupler->receive(inflow) || inflow.type != coupling::Type::inflow || inflow.step != n - 1 - in.coupling_lag)
+                throw std::runtime_error("Coupling: missing inflow for time step " + std::to_string(n - 1 - in.coupling_lag));
+            coupling_wait.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+
+            solver.u_inlet_value = inflow.values[coupling::u_inlet];
+            solver.T_inlet_value = inflow.values[coupling::T_inlet];
+            solver.p_outlet_value = inflow.values[coupling::p_outlet];
+        }
+
+        solver.step();
+
+        const double change = solver.step_change();
+
+        // ===============================================================
+        // DMD ACCELERATION
+        // ===============================================================
+
+        if (in.dmd_every > 0) {
+
+            if (verifying) {
+
+                verifying = false;
+
+                if (change > change_before_jump) {
+
+                    solver.u_l = u_saved;
+                    solver.p_l = p_saved;
+                    solver.T_l = T_saved;
+                    solver.sync_pressure_storage();
+                    ++jumps_rejected;
+                }
+                else ++jumps_accepted;
+            }
+            else {
+
+                if (extrapolator.empty())
+                    dmd_scale = { magnitude(solver.u_l), magnitude(solver.p_l), magnitude(solver.T_l) };
+
+                dmd_state.resize(3 * N);
+                for (int i = 0; i < N; ++i) {
+                    dmd_state[i] = solver.u_l[i] / dmd_scale[0];
+                    dmd_state[N + i] = solver.p_l[i] / dmd_scale[1];
+                    dmd_state[2 * N + i] = solver.T_l[i] / dmd_scale[2];
+                }
+                extrapolator.push(dmd_state);
+
+                if (++steps_since_jump >= in.dmd_every && extrapolator.extrapolate(dmd_state)) {
+
+                    u_saved = solver.u_l;
+                    p_saved = solver.p_l;
+                    T_saved = solver.T_l;
+
+                    for (int i = 0; i < N; ++i) {
+                        solver.u_l[i] = dmd_state[i] * dmd_scale[0];
+                        solver.p_l[i] = dmd_state[N + i] * dmd_scale[1];
+                        solver.T_l[i] = dmd_state[2 * N + i] * dmd_scale[2];
+                    }
+                    solver.sync_pressure_storage();
+
+                    verifying = true;
+                    change_before_jump = change;
+                    extrapolator.clear();
+                }
+
+                if (steps_since_jump >= in.dmd_every) steps_since_jump = 0;
+            }
+        }
+
+        // A state just extrapolated to is not steady until verified
+        const bool steady = in.steady_tol > 0.0 && change <= in.steady_tol && !verifying;
+        if (steady) steady_step = n;
+
+        if (coupler) {
+
+            coupling::Record outflow;
+            outflow.type = coupling::Type::outflow;
+            outflow.step = n;
+            outflow.time = solver.time_total;
+            outflow.values[coupling::u_outlet] = solver.u_l[N - 1];
+            outflow.values[coupling::T_outlet] = solver.T_l[N - 1];
+            outflow.values[coupling::p_inlet] = solver.p_l[0];
+            outflow.values[coupling::mass_flux] = solver.rho_l * solver.u_l[N - 1];
+            outflow.values[coupling::heat_flux] = solver.rho_l * solver.cp * solver.u_l[N - 1] * solver.T_l[N - 1];
+
+            coupler->send(outflow);
+        }
+
+        if (live_out && (n % in.live_fields_every == 0 || n == time_steps || steady))
+            live_out->publish(n, solver.time_total,
+                { solver.continuity_residual, solver.momentum_residual, solver.energy_residual },
+                solver.u_l.data(), solver.p_l.data(), solver.T_l.data());
+
+        // ===============================================================
+        // OUTPUT
+        // ===============================================================
+
+        if (n % print_every == 0 || steady) {
+
+            if (pending_output.valid()) pending_output.wait();
+
+            u_snapshot = solver.u_l;
+            p_snapshot = solver.p_l;
+            T_snapshot = solver.T_l;
+
+            for (std::size_t s = 0; s < scalar_snapshot.size(); ++s)
+                scalar_snapshot[s] = solver.scalars[s].phi;
+
+            pending_output = std::async(std::launch::async, [&]() {
+
+                for (int i = 0; i < N; ++i) {
+
+                    v_out << u_snapshot[i] << ", ";
+                    p_out << p_snapshot[i] << ", ";
+                    T_out << T_snapshot[i] << ", ";
+                }
+
+                v_out << "\n";
+                p_out << "\n";
+                T_out << "\n";
+
+                for (std::size_t s = 0; s < scalar_snapshot.size(); ++s) {
+
+                    for (int i = 0; i < N; ++i)
+                        scalar_out[s] << scalar_snapshot[s][i] << ", ";
+
+                    scalar_out[s] << "\n";
+                }
+            });
+        }
+
+        if (steady) break;
+    }
+
+    if (live_out) live_out->finish();
+
+    if (coupler) {
+        coupling::Record end;
+        end.type = coupling::Type::end;
+        coupler->send(end);
+    }
+
+    if (pending_output.valid()) pending_output.wait();
+
+    v_out.flush();
+    p_out.flush();
+    T_out.flush();
+
+    v_out.close();
+    p_out.close();
+    T_out.close();
+
+    for (std::ofstream& out : scalar_out) out.close();
+
+    // Running statistics, written once
+    solver.finish_statistics();
+
+    if (in.statistics) {
+
+        std::ofstream stats_out(outputDir / in.statistics_file);
+
+        stats_out << "# " << solver.u_stats.count << " time levels in [" << in.statistics_start << ", "
+            << in.statistics_end << "] s; rms is the RMS of the fluctuation about the mean\n";
+        stats_out << "# z, u_mean, u_rms, u_min, u_max, p_mean, p_rms, p_min, p_max, T_mean, T_rms, T_min, T_max\n";
+
+        for (int i = 0; i < N; ++i) {
+            stats_out << (i + 0.5) * solver.dz;
+            for (const statistics::Running* s : { &solver.u_stats, &solver.p_stats, &solver.T_stats })
+                stats_out << ", " << s->mean[i] << ", " << s->rms(i) << ", " << s->min[i] << ", " << s->max[i];
+            stats_out << "\n";
+        }
+    }
+
+    double end = omp_get_wtime();
+    printf("Execution time: %.6f s\n", end - start);
+
+    printf("PISO iterations: %lld outer, %lld inner, %lld residual evaluations\n",
+        solver.total_outer_l, solver.total_inner_l, solver.residual_checks_l);
+
+    if (solver.speculative_inner)
+        printf("Discarded speculative corrections: %lld\n", solver.discarded_inner_l);
+
+    if (solver.inner_tol_adaptive)
+        printf("Adaptive inner tolerance: %lld inner solves stopped above piso_inner_tol, skipping about %lld inner iterations\n",
+            solver.early_stops_l, solver.skipped_inner_l);
+
+    if (solver.momentum_freeze_tol > 0.0)
+        printf("Momentum matrix reused in %lld of %lld outer iterations\n", solver.frozen_momentum_l, solver.total_outer_l);
+
+    if (in.piso_step_budget > 0 || in.piso_step_time_budget > 0.0)
+        printf("Steps ending above the outer tolerance: %lld of %d\n", solver.unconverged_steps_l, steady_step >= 0 ? steady_step + 1 : time_steps + 1);
+
+    if (steady_step >= 0)
+        printf("Steady state after %d time steps\n", steady_step + 1);
+
+    if (in.dmd_every > 0)
+        printf("DMD extrapolations: %lld accepted, %lld rejected\n", jumps_accepted, jumps_rejected);
+
+    if (!coupling_wait.empty()) {
+        const double waited = std::accumulate(coupling_wait.begin(), coupling_wait.end(), 0.0);
+        std::sort(coupling_wait.begin(), coupling_wait.end());
+        printf("Coupling: waited %.6f s for %zu answers (lag %d), p99 %.2f us, max %.2f us\n",
+            waited * 1e-6, coupling_wait.size(), in.coupling_lag,
+            coupling_wait[static_cast<std::size_t>(0.99 * (coupling_wait.size() - 1) + 0.5)], coupling_wait.back());
+    }
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "adi.h"
+#include "tdma.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace adi {
+
+void Stencil::resize(int nz_, int nr_) {
+
+    nz = nz_;
+    nr = nr_;
+
+    const std::size_t n = static_cast<std::size_t>(nz) * nr;
+    for (auto* v : { &aW, &aE, &aS, &aN, &aP, &b })
+        v->assign(n, 0.0);
+}
+
+static bool uncoupled(const Stencil& s, int p) {
+    return s.aW[p] == 0.0 && s.aE[p] == 0.0 && s.aS[p] == 0.0 && s.aN[p] == 0.0;
+}
+
+// Residual of cell (i, j)
+static double cell_residual(const Stencil& s, const std::vector<double>& x, int i, int j) {
+
+    const int nz = s.nz, nr = s.nr;
+    const int p = j * nz + i;
+
+    return s.b[p] - s.aP[p] * x[p]
+        + (i > 0 ? s.aW[p] * x[p - 1] : 0.0)
+        + (i < nz - 1 ? s.aE[p] * x[p + 1] : 0.0)
+        + (j > 0 ? s.aS[p] * x[p - nz] : 0.0)
+        + (j < nr - 1 ? s.aN[p] * x[p + nz] : 0.0);
+}
+
+void block_correct(const Stencil& s, std::vector<double>& x) {
+
+    const int nz = s.nz, nr = s.nr;
+
+    // Along z: sum the equations of each column over r, the radial couplings
+    // within the column cancel against the diagonal
+    if (nz > 1) {
+
+        std::vector<double> a(nz, 0.0), b(nz, 0.0), c(nz, 0.0), d(nz, 0.0);
+
+        for (int j = 0; j < nr; ++j) {
+            for (int i = 0; i < nz; ++i) {
+
+                const int p = j * nz + i;
+                if (uncoupled(s, p)) continue;
+
+                a[i] -= s.aW[p];
+                b[i] += s.aP[p] - s.aS[p] - s.aN[p];
+                c[i] -= s.aE[p];
+                d[i] += cell_residual(s, x, i, j);
+            }
+        }
+
+        for (int i = 0; i < nz; ++i)
+            if (b[i] == 0.0) b[i] = 1.0;            // Column of uncoupled rows only
+
+        const std::vector<double> shift = tdma::solve(a, b, c, d);
+
+        for (int j = 0; j < nr; ++j)
+            for (int i = 0; i < nz; ++i)
+                if (!uncoupled(s, j * nz + i)) x[j * nz + i] += shift[i];
+    }
+
+    // Along r: same with the rows summed over z
+    if (nr > 1) {
+
+        std::vector<double> a(nr, 0.0), b(nr, 0.0), c(nr, 0.0), d(nr, 0.0);
+
+        for (int j = 0; j < nr; ++j) {
+            for (int i = 0; i < nz; ++i) {
+
+                const int p = j * nz + i;
+                if (uncoupled(s, p)) continue;
+
+                a[j] -= s.aS[p];
+                b[j] += s.aP[p] - s.aW[p] - s.aE[p];
+                c[j] -= s.aN[p];
+                d[j] += cell_residual(s, x, i, j);
+            }
+        }
+
+        for (int j = 0; j < nr; ++j)
+            if (b[j] == 0.0) b[j] = 1.0;            // Row of uncoupled rows only
+
+        const std::vector<double> shift = tdma::solve(a, b, c, d);
+
+        for (int j = 0; j < nr; ++j)
+            for (int i = 0; i < nz; ++i)
+                if (!uncoupled(s, j * nz + i)) x[j * nz + i] += shift[j];
+    }
+}
+
+void sweep(const Stencil& s, std::vector<double>& x, Workspace& work) {
+
+    const int nz = s.nz, nr = s.nr;
+    const int n = nz * nr;
+
+    work.a.resize(n);
+    work.b.resize(n);
+    work.c.resize(n);
+    work.d.resize(n);
+
+    // z-lines: one contiguous system per radial row
+    for (int colour = 0; colour < 2; ++colour) {
+
+        const int lines = (nr - colour + 1) / 2;
+
+        #pragma omp parallel for schedule(static)
+        for (int j = colour; j < nr; j += 2) {
+            for (int i = 0; i < nz; ++i) {
+
+                const int p = j * nz + i;
+
+                work.a[p] = -s.aW[p];
+                work.b[p] = s.aP[p];
+                work.c[p] = -s.aE[p];
+                work.d[p] = s.b[p]
+                    + (j > 0 ? s.aS[p] * x[p - nz] : 0.0)
+                    + (j < nr - 1 ? s.aN[p] * x[p + nz] : 0.0);
+            }
+        }
+
+        tdma::solve_batched(work.a, work.b, work.c, work.d, nz, lines, 1, 2 * nz, colour * nz);
+
+        #pragma omp parallel for schedule(static)
+        for (int j = colour; j < nr; j += 2)
+            std::copy(work.d.begin() + j * nz, work.d.begin() + (j + 1) * nz, x.begin() + j * nz);
+    }
+
+    // r-lines: one system per axial column, rows nz apart
+    for (int colour = 0; colour < 2; ++colour) {
+
+        const int lines = (nz - colour + 1) / 2;
+
+        #pragma omp parallel for schedule(static)
+        for (int j = 0; j < nr; ++j) {
+            for (int i = colour; i < nz; i += 2) {
+
+                const int p = j * nz + i;
+
+                work.a[p] = -s.aS[p];
+                work.b[p] = s.aP[p];
+                work.c[p] = -s.aN[p];
+                work.d[p] = s.b[p]
+                    + (i > 0 ? s.aW[p] * x[p - 1] : 0.0)
+                    + (i < nz - 1 ? s.aE[p] * x[p + 1] : 0.0);
+            }
+        }
+
+        tdma::solve_batched(work.a, work.b, work.c, work.d, nr, lines, nz, 2, colour);
+
+        #pragma omp parallel for schedule(static)
+        for (int j = 0; j < nr; ++j)
+            for (int i = colour; i < nz; i += 2)
+                x[j * nz + i] = work.d[j * nz + i];
+    }
+}
+
+void relax(const Stencil& s, std::vector<double>& x, int sweeps, Workspace& work) {
+
+    for (int k = 0; k < sweeps; ++k) {
+        block_correct(s, x);
+        sweep(s, x, work);
+    }
+}
+
+double residual(const Stencil& s, const std::vector<double>& x) {
+
+    double r = 0.0;
+
+    for (int j = 0; j < s.nr; ++j)
+        for (int i = 0; i < s.nz; ++i)
+            r = std::max(r, std::abs(cell_residual(s, x, i, j) / s.aP[j * s.nz + i]));
+
+    return r;
+}
+
+void residuals(const Stencil& s, const std::vector<double>& x, std::vector<double>& r) {
+
+    r.resize(x.size());
+
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < s.nr; ++j)
+        for (int i = 0; i < s.nz; ++i)
+            r[j * s.nz + i] = cell_residual(s, x, i, j);
+}
+
+}
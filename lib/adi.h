@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+namespace adi {
+
+    // Five-point system on an nz x nr structured grid, cell (i, j) stored at
+    // j * nz + i:
+    //   aP x_P = aW x_W + aE x_E + aS x_S + aN x_N + b
+    // W/E are the axial neighbours, S/N the radial ones. Couplings pointing
+    // out of the grid must be zero.
+    struct Stencil {
+        int nz = 0;
+        int nr = 0;
+        std::vector<double> aW, aE, aS, aN, aP, b;
+
+        void resize(int nz, int nr);
+    };
+
+    // Line coefficients reused between sweeps
+    struct Workspace {
+        std::vector<double> a, b, c, d;
+    };
+
+    // Additive block correction: shifts every z-column (r-row) of x by the
+    // constant that zeroes its summed residual, the shifts coming from one
+    // tridiagonal solve along z (r). This removes the smooth error modes that
+    // line relaxation damps very slowly when the cross-line couplings dominate.
+    // Rows without couplings (eliminated boundary nodes) are left out.
+    void block_correct(const Stencil& s, std::vector<double>& x);
+
+    // One alternating-direction sweep: the z-lines, then the r-lines, each
+    // direction in zebra order (even lines, then odd lines using the new even
+    // ones) so every half is one batch of independent tridiagonal systems
+    void sweep(const Stencil& s, std::vector<double>& x, Workspace& work);
+
+    // Line relaxation: every sweep is a block correction followed by an
+    // alternating-direction sweep
+    void relax(const Stencil& s, std::vector<double>& x, int sweeps, Workspace& work);
+
+    // Max-norm of the residual scaled by the diagonal,
+    // (b + sum(a_nb x_nb) - aP x_P) / aP, in units of x
+    double residual(const Stencil& s, const std::vector<double>& x);
+
+    // Unscaled residual of every cell, b + sum(a_nb x_nb) - aP x_P
+    void residuals(const Stencil& s, const std::vector<double>& x, std::vector<double>& r);
+}
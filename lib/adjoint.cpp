@@ -0,0 +1,135 @@
+#include "adjoint.h"
+#include "tdma.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace adjoint {
+
+int Tape::push_tridiagonal(
+    const std::vector<int>& ia, const std::vector<int>& ib,
+    const std::vector<int>& ic, const std::vector<int>& id,
+    std::vector<double> a, std::vector<double> b,
+    std::vector<double> c, std::vector<double> x)
+{
+    Tridiagonal solve;
+    solve.first = size();
+    solve.ia = ia;
+    solve.ib = ib;
+    solve.ic = ic;
+    solve.id = id;
+    solve.a = std::move(a);
+    solve.b = std::move(b);
+    solve.c = std::move(c);
+    solve.x = std::move(x);
+
+    // The outputs are parentless nodes; their adjoints are passed on by the block
+    for (std::size_t k = 0; k < solve.x.size(); ++k) push(0, 0.0);
+
+    const int first = solve.first;
+    solves_.push_back(std::move(solve));
+    return first;
+}
+
+void Tape::grow() {
+
+    nodes_.resize(std::max<std::size_t>(2 * nodes_.size(), 1 << 16));
+    buffer_ = nodes_.data();
+    capacity_ = static_cast<int>(nodes_.size());
+}
+
+void Tape::clear() {
+
+    size_ = 0;
+    push(0, 0.0);
+
+    adjoints_.clear();
+    adjoints_.clear();
+    solves_.clear();
+}
+
+void Tape::reverse() {
+
+    if (static_cast<int>(adjoints_.size()) != size_) adjoints_.assign(size_, 0.0);
+
+    int block = static_cast<int>(solves_.size()) - 1;
+
+    // Missing parents are the sink, node 0, with zero weight: no branches
+    for (int i = size() - 1; i > 0; --i) {
+
+        const Node& node = buffer_[i];
+        const double adj = adjoints_[i];
+
+        adjoints_[node.p0] += node.w0 * adj;
+        adjoints_[node.p1] += node.w1 * adj;
+
+        // All uses of a solve's outputs lie after it: its block runs when the
+        // sweep reaches the first output
+        if (block >= 0 && solves_[block].first == i) {
+
+            const Tridiagonal& s = solves_[block--];
+            const int n = static_cast<int>(s.x.size());
+
+            // A^T y = adjoint of x: the sub- and super-diagonals swap places
+            std::vector<double> at(n, 0.0), ct(n, 0.0), x_adj(n);
+            for (int k = 0; k < n; ++k) {
+                if (k > 0) at[k] = s.c[k - 1];
+                if (k < n - 1) ct[k] = s.a[k + 1];
+                x_adj[k] = adjoints_[i + k];
+            }
+
+            const std::vector<double> y = tdma::solve(at, s.b, ct, x_adj);
+
+            for (int k = 0; k < n; ++k) {
+                if (s.id[k] >= 0) adjoints_[s.id[k]] += y[k];
+                if (s.ib[k] >= 0) adjoints_[s.ib[k]] -= y[k] * s.x[k];
+                if (k > 0 && s.ia[k] >= 0) adjoints_[s.ia[k]] -= y[k] * s.x[k - 1];
+                if (k < n - 1 && s.ic[k] >= 0) adjoints_[s.ic[k]] -= y[k] * s.x[k + 1];
+            }
+        }
+    }
+}
+
+}
+
+namespace tdma {
+
+std::vector<adjoint::Var> solve(
+    const std::vector<adjoint::Var>& a,
+    const std::vector<adjoint::Var>& b,
+    const std::vector<adjoint::Var>& c,
+    const std::vector<adjoint::Var>& d)
+{
+    const int n = b.size();
+    if (static_cast<int>(a.size()) != n || static_cast<int>(c.size()) != n || static_cast<int>(d.size()) != n)
+        throw std::runtime_error("TDMA: size mismatch");
+
+    std::vector<double> av(n), bv(n), cv(n), dv(n);
+    std::vector<int> ia(n), ib(n), ic(n), id(n);
+    bool constant = true;
+
+    for (int k = 0; k < n; ++k) {
+        av[k] = a[k].v; ia[k] = a[k].i;
+        bv[k] = b[k].v; ib[k] = b[k].i;
+        cv[k] = c[k].v; ic[k] = c[k].i;
+        dv[k] = d[k].v; id[k] = d[k].i;
+        constant = constant && ia[k] < 0 && ib[k] < 0 && ic[k] < 0 && id[k] < 0;
+    }
+
+    std::vector<double> xv = tdma::solve(av, bv, cv, dv);
+    std::vector<adjoint::Var> x(n);
+
+    if (constant) {
+        for (int k = 0; k < n; ++k) x[k] = adjoint::Var(xv[k]);
+        return x;
+    }
+
+    const int first = adjoint::Tape::active->push_tridiagonal(ia, ib, ic, id,
+        std::move(av), std::move(bv), std::move(cv), xv);
+
+    for (int k = 0; k < n; ++k) x[k] = adjoint::Var(xv[k], first + k);
+
+    return x;
+}
+
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "dual.h"
+
+#include <vector>
+
+namespace adjoint {
+
+    // Record of the operations of one forward pass, played back in reverse to
+    // propagate adjoints. Every non-constant value is a node with up to two
+    // parents and the partial derivatives with respect to them; tridiagonal
+    // solves are single blocks whose adjoint is the transposed solve, instead
+    // of the elimination steps one by one.
+    class Tape {
+    public:
+        // Tape recording on the calling thread, nullptr when none
+        static inline thread_local Tape* active = nullptr;
+
+        Tape() { clear(); }
+
+        DUAL_INLINE int variable() { return push(0, 0.0); }    // New independent node
+
+        // Node with parents p0 and p1 (node 0, a sink, for none)
+        DUAL_INLINE int push(int p0, double w0, int p1 = 0, double w1 = 0.0) {
+            if (size_ == capacity_) grow();
+            Node& node = buffer_[size_];
+            node.p0 = p0; node.p1 = p1; node.w0 = w0; node.w1 = w1;
+            return size_++;
+        }
+
+        // Block of n outputs x of the tridiagonal system with the given rows
+        // (node indices, -1 for constants) and values. Returns the first output.
+        int push_tridiagonal(
+            const std::vector<int>& ia, const std::vector<int>& ib,
+            const std::vector<int>& ic, const std::vector<int>& id,
+            std::vector<double> a, std::vector<double> b,
+            std::vector<double> c, std::vector<double> x
+        );
+
+        void clear();
+        int size() const { return size_; }
+
+        // Adjoints, seeded by the caller before reverse(); zero until seeded
+        double& adjoint(int i) {
+            if (static_cast<int>(adjoints_.size()) != size_) adjoints_.assign(size_, 0.0);
+            return adjoints_[i];
+        }
+
+        void reverse();
+
+    private:
+        struct Node {
+            int p0, p1;
+            double w0, w1;
+        };
+
+        struct Tridiagonal {
+            int first = 0;
+            std::vector<int> ia, ib, ic, id;
+            std::vector<double> a, b, c, x;
+        };
+
+        // Nodes [0, size_) of the buffer, which only grows: recording is a store
+        // and an increment, without the bookkeeping of push_back
+        std::vector<Node> nodes_;
+        Node* buffer_ = nullptr;
+        int size_ = 0;
+        int capacity_ = 0;
+
+        void grow();
+
+        std::vector<double> adjoints_;
+        std::vector<Tridiagonal> solves_;
+    };
+
+    // Real number recorded on the active tape. Constants (index -1) are not
+    // recorded, nor are operations whose operands are all constants.
+    // Comparisons look at the value only, like dual::Dual.
+    struct Var {
+        double v = 0.0;                     // Value
+        int i = -1;                         // Tape node, -1 for a constant
+
+        Var() = default;
+        DUAL_INLINE Var(double value) : v(value) {}
+        DUAL_INLINE Var(double value, int index) : v(value), i(index) {}
+
+        static DUAL_INLINE Var unary(double v, const Var& x, double dx) {
+            if (x.i < 0) return Var(v);
+            return Var(v, Tape::active->push(x.i, dx));
+        }
+
+        static DUAL_INLINE Var binary(double v, const Var& x, double dx, const Var& y, double dy) {
+            if (x.i < 0) return unary(v, y, dy);
+            if (y.i < 0) return unary(v, x, dx);
+            return Var(v, Tape::active->push(x.i, dx, y.i, dy));
+        }
+
+        DUAL_INLINE Var& operator+=(const Var& y) { *this = *this + y; return *this; }
+        DUAL_INLINE Var& operator-=(const Var& y) { *this = *this - y; return *this; }
+        DUAL_INLINE Var& operator*=(const Var& y) { *this = *this * y; return *this; }
+        DUAL_INLINE Var& operator/=(const Var& y) { *this = *this / y; return *this; }
+
+        friend DUAL_INLINE Var operator+(const Var& x) { return x; }
+        friend DUAL_INLINE Var operator-(const Var& x) { return unary(-x.v, x, -1.0); }
+
+        friend DUAL_INLINE Var operator+(const Var& x, const Var& y) { return binary(x.v + y.v, x, 1.0, y, 1.0); }
+        friend DUAL_INLINE Var operator-(const Var& x, const Var& y) { return binary(x.v - y.v, x, 1.0, y, -1.0); }
+        friend DUAL_INLINE Var operator*(const Var& x, const Var& y) { return binary(x.v * y.v, x, y.v, y, x.v); }
+        friend DUAL_INLINE Var operator/(const Var& x, const Var& y) {
+            const double r = x.v / y.v;
+            return binary(r, x, 1.0 / y.v, y, -r / y.v);
+        }
+
+        friend DUAL_INLINE Var operator+(const Var& x, double y) { return unary(x.v + y, x, 1.0); }
+        friend DUAL_INLINE Var operator+(double x, const Var& y) { return unary(x + y.v, y, 1.0); }
+        friend DUAL_INLINE Var operator-(const Var& x, double y) { return unary(x.v - y, x, 1.0); }
+        friend DUAL_INLINE Var operator-(double x, const Var& y) { return unary(x - y.v, y, -1.0); }
+        friend DUAL_INLINE Var operator*(const Var& x, double y) { return unary(x.v * y, x, y); }
+        friend DUAL_INLINE Var operator*(double x, const Var& y) { return unary(x * y.v, y, x); }
+        friend DUAL_INLINE Var operator/(const Var& x, double y) { return unary(x.v / y, x, 1.0 / y); }
+        friend DUAL_INLINE Var operator/(double x, const Var& y) {
+            const double r = x / y.v;
+            return unary(r, y, -r / y.v);
+        }
+
+        friend DUAL_INLINE bool operator<(const Var& x, const Var& y) { return x.v < y.v; }
+        friend DUAL_INLINE bool operator>(const Var& x, const Var& y) { return x.v > y.v; }
+        friend DUAL_INLINE bool operator<=(const Var& x, const Var& y) { return x.v <= y.v; }
+        friend DUAL_INLINE bool operator>=(const Var& x, const Var& y) { return x.v >= y.v; }
+    };
+}
+
+// Scalar helpers of the solver templates, for taped values
+namespace dual {
+    DUAL_INLINE double value(const adjoint::Var& x) { return x.v; }
+    DUAL_INLINE double& value_ref(adjoint::Var& x) { return x.v; }
+    DUAL_INLINE void seed(adjoint::Var&, int, double = 1.0) {}
+
+    DUAL_INLINE adjoint::Var abs(const adjoint::Var& x) { return x.v < 0.0 ? -x : x; }
+    DUAL_INLINE adjoint::Var sqrt(const adjoint::Var& x) {
+        const double r = std::sqrt(x.v);
+        return adjoint::Var::unary(r, x, 0.5 / r);
+    }
+}
+
+// Tridiagonal solve of taped values: one block on the tape, reversed by the
+// transposed solve
+namespace tdma {
+    std::vector<adjoint::Var> solve(
+        const std::vector<adjoint::Var>& a,
+        const std::vector<adjoint::Var>& b,
+        const std::vector<adjoint::Var>& c,
+        const std::vector<adjoint::Var>& d
+    );
+}
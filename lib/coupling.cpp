@@ -0,0 +1,178 @@
+#include "coupling.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace coupling {
+
+#ifdef _WIN32
+using native_socket = SOCKET;
+static const native_socket no_socket = INVALID_SOCKET;
+static void close_socket(native_socket s) { closesocket(s); }
+static const int send_flags = 0;
+static void keep_sigpipe_off(native_socket) {}
+
+// Winsock is started once per process
+static void start_sockets() {
+    static const bool started = [] { WSADATA data; return WSAStartup(MAKEWORD(2, 2), &data) == 0; }();
+    if (!started) throw std::runtime_error("Coupling: cannot start Winsock");
+}
+#else
+using native_socket = int;
+static const native_socket no_socket = -1;
+static void close_socket(native_socket s) { ::close(s); }
+static void start_sockets() {}
+
+// A peer that has gone away must fail the send, not raise SIGPIPE and end the
+// process: per call where MSG_NOSIGNAL exists, per socket elsewhere
+#ifdef MSG_NOSIGNAL
+static const int send_flags = MSG_NOSIGNAL;
+static void keep_sigpipe_off(native_socket) {}
+#else
+static const int send_flags = 0;
+static void keep_sigpipe_off(native_socket s) {
+#ifdef SO_NOSIGPIPE
+    const int on = 1;
+    ::setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+#endif
+#endif
+
+static native_socket native(std::intptr_t s) { return static_cast<native_socket>(s); }
+
+static sockaddr_un address(const std::string& path) {
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Coupling: socket path empty or too long: " + path);
+
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    return addr;
+}
+
+Channel::~Channel() {
+    close();
+}
+
+void Channel::close() {
+    if (socket_ != -1) close_socket(native(socket_));
+    socket_ = -1;
+}
+
+void Channel::send(const Record* records, std::size_t count) {
+
+    const char* data = reinterpret_cast<const char*>(records);
+    std::size_t left = count * sizeof(Record);
+
+    while (left > 0) {
+        const auto sent = ::send(native(socket_), data, static_cast<int>(left), send_flags);
+        if (sent <= 0) throw std::runtime_error("Coupling: send failed");
+        data += sent;
+        left -= static_cast<std::size_t>(sent);
+    }
+}
+
+bool Channel::receive(Record& record) {
+
+    while (end_ - begin_ < sizeof(Record)) {
+
+        // Keeps a partial record at the front and fills up behind it
+        if (begin_ > 0) {
+            std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+
+        const auto got = ::recv(native(socket_), buffer_.data() + end_, static_cast<int>(buffer_.size() - end_), 0);
+        if (got == 0) return false;
+        if (got < 0) throw std::runtime_error("Coupling: receive failed");
+        end_ += static_cast<std::size_t>(got);
+    }
+
+    std::memcpy(&record, buffer_.data() + begin_, sizeof(Record));
+    begin_ += sizeof(Record);
+    return true;
+}
+
+Server::Server(const std::string& path)
+    : path_(path)
+{
+    start_sockets();
+
+    const sockaddr_un addr = address(path);
+
+    native_socket listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == no_socket) throw std::runtime_error("Coupling: cannot create socket");
+
+    // A socket file left behind by an earlier run is replaced
+    std::remove(path.c_str());
+
+    // The destructor does not run for a constructor that throws, so the
+    // listener and its socket file are released here
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listener, 1) != 0) {
+        close_socket(listener);
+        std::remove(path.c_str());
+        throw std::runtime_error("Coupling: cannot listen on " + path);
+    }
+
+    native_socket s = ::accept(listener, nullptr, nullptr);
+    if (s == no_socket) {
+        close_socket(listener);
+        std::remove(path.c_str());
+        throw std::runtime_error("Coupling: accept failed on " + path);
+    }
+
+    keep_sigpipe_off(s);
+    listener_ = static_cast<std::intptr_t>(listener);
+    socket_ = static_cast<std::intptr_t>(s);
+}
+
+Server::~Server() {
+    close();
+    if (listener_ != -1) close_socket(native(listener_));
+    std::remove(path_.c_str());
+}
+
+Client::Client(const std::string& path) {
+
+    start_sockets();
+
+    const sockaddr_un addr = address(path);
+
+    for (int attempt = 0; ; ++attempt) {
+
+        native_socket s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s == no_socket) throw std::runtime_error("Coupling: cannot create socket");
+
+        if (::connect(s, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) {
+            keep_sigpipe_off(s);
+            socket_ = static_cast<std::intptr_t>(s);
+            return;
+        }
+
+        close_socket(s);
+
+        if (attempt == 100) throw std::runtime_error("Coupling: cannot connect to " + path);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+}
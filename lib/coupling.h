@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace coupling {
+
+    // Fixed-size record of the coupling protocol, one cache line, in host byte
+    // order (both ends run on the same host). The solver sends an outflow
+    // record after every time step; the client answers each with an inflow
+    // record for the same step. Pings are echoed as they are.
+    enum class Type : std::uint32_t { outflow = 1, inflow = 2, ping = 3, end = 4 };
+
+    struct Record {
+        Type          type = Type::ping;
+        std::uint32_t reserved = 0;
+        std::int64_t  step = 0;
+        double        time = 0.0;
+        double        values[5] = {};
+    };
+
+    static_assert(sizeof(Record) == 64, "coupling::Record must stay one cache line");
+
+    // Outflow values: outlet velocity [m/s], outlet temperature [K], inlet
+    // pressure [Pa], outlet mass flux [kg/(m2 s)], outlet enthalpy flux [W/m2]
+    enum Outflow { u_outlet = 0, T_outlet = 1, p_inlet = 2, mass_flux = 3, heat_flux = 4 };
+
+    // Inflow values: inlet velocity [m/s], inlet temperature [K], outlet pressure [Pa]
+    enum Inflow { u_inlet = 0, T_inlet = 1, p_outlet = 2 };
+
+    // Connected stream socket exchanging records. Sends of several records go
+    // out in one write, receives take whatever has arrived, so batches on
+    // either side cost one system call.
+    class Channel {
+    public:
+        ~Channel();
+
+        Channel(const Channel&) = delete;
+        Channel& operator=(const Channel&) = delete;
+
+        void send(const Record* records, std::size_t count);
+        void send(const Record& record) { send(&record, 1); }
+
+        // Next record, waiting for it; false once the peer has closed
+        bool receive(Record& record);
+
+        // Records already received and not yet taken, without waiting
+        std::size_t buffered() const { return (end_ - begin_) / sizeof(Record); }
+
+    protected:
+        Channel() = default;
+        void close();
+
+        std::intptr_t socket_ = -1;
+
+    private:
+        std::vector<char> buffer_ = std::vector<char>(64 * sizeof(Record));
+        std::size_t begin_ = 0, end_ = 0;
+    };
+
+    // Solver side: listens on the socket path and accepts one client
+    class Server : public Channel {
+    public:
+        explicit Server(const std::string& path);
+        ~Server();
+
+    private:
+        std::string path_;
+        std::intptr_t listener_ = -1;
+    };
+
+    // Client side: connects to the solver's socket, retrying while it starts
+    class Client : public Channel {
+    public:
+        explicit Client(const std::string& path);
+    };
+}
@@ -0,0 +1,119 @@
+#include "dmd.h"
+#include "rom.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace dmd {
+
+Extrapolator::Extrapolator(int window, double rank_tol)
+    : window_(std::max(window, 3)), rank_tol_(rank_tol)
+{
+}
+
+void Extrapolator::push(const std::vector<double>& x) {
+
+    snapshots_.push_back(x);
+    if (static_cast<int>(snapshots_.size()) > window_) snapshots_.pop_front();
+}
+
+bool Extrapolator::extrapolate(std::vector<double>& x) const {
+
+    if (!full()) return false;
+
+    const int m = window_ - 1;                      // Increments in the window
+    const std::size_t n = snapshots_[0].size();
+
+    std::vector<std::vector<double>> d(m, std::vector<double>(n));
+    for (int k = 0; k < m; ++k)
+        for (std::size_t i = 0; i < n; ++i)
+            d[k][i] = snapshots_[k + 1][i] - snapshots_[k][i];
+
+    // U S V^T of the first m - 1 increments
+    std::vector<std::vector<double>> U(d.begin(), d.end() - 1);
+    std::vector<double> sigma;
+    rom::svd(U, sigma);
+
+    int r = 0;
+    while (r < static_cast<int>(sigma.size()) && sigma[r] > rank_tol_ * sigma[0]) ++r;
+    if (r == 0) return false;
+
+    auto dot = [](const std::vector<double>& a, const std::vector<double>& b) {
+        double s = 0.0;
+        for (std::size_t i = 0; i < a.size(); ++i) s += a[i] * b[i];
+        return s;
+    };
+
+    // V = D^T U S^-1, then At = U^T D' V S^-1 with D' the increments shifted by one
+    std::vector<double> V((m - 1) * r);
+    for (int k = 0; k < m - 1; ++k)
+        for (int j = 0; j < r; ++j)
+            V[k * r + j] = dot(d[k], U[j]) / sigma[j];
+
+    std::vector<double> UtD(r * (m - 1));
+    for (int i = 0; i < r; ++i)
+        for (int k = 0; k < m - 1; ++k)
+            UtD[i * (m - 1) + k] = dot(U[i], d[k + 1]);
+
+    std::vector<double> At(r * r, 0.0);
+    for (int i = 0; i < r; ++i)
+        for (int j = 0; j < r; ++j) {
+            double s = 0.0;
+            for (int k = 0; k < m - 1; ++k) s += UtD[i * (m - 1) + k] * V[k * r + j];
+            At[i * r + j] = s / sigma[j];
+        }
+
+    // Spectral radius from the growth of At^(2^6), robust to complex pairs
+    std::vector<double> P = At;
+    double log_norm = 0.0;
+
+    for (int squaring = 0; squaring < 6; ++squaring) {
+
+        std::vector<double> Q(r * r, 0.0);
+        for (int i = 0; i < r; ++i)
+            for (int k = 0; k < r; ++k)
+                for (int j = 0; j < r; ++j)
+                    Q[i * r + j] += P[i * r + k] * P[k * r + j];
+
+        double norm = 0.0;
+        for (double q : Q) norm = std::max(norm, std::abs(q));
+        if (norm == 0.0) { log_norm = -1e300; break; }
+
+        // Renormalized to avoid overflow, the scale is kept in log_norm
+        for (double& q : Q) q /= norm;
+        log_norm = 2.0 * log_norm + std::log(norm);
+        P = std::move(Q);
+    }
+
+    radius_ = std::exp(log_norm / 64.0);
+    if (radius_ >= 1.0) return false;
+
+    // Sum of the remaining increments in reduced coordinates
+    std::vector<double> c(r);
+    for (int i = 0; i < r; ++i) c[i] = dot(U[i], d[m - 1]);
+
+    std::vector<double> I_minus_At(r * r), rhs(r, 0.0);
+    for (int i = 0; i < r; ++i)
+        for (int j = 0; j < r; ++j) {
+            I_minus_At[i * r + j] = (i == j ? 1.0 : 0.0) - At[i * r + j];
+            rhs[i] += At[i * r + j] * c[j];
+        }
+
+    std::vector<double> y;
+    try {
+        y = rom::solve_dense(I_minus_At, rhs, r);
+    }
+    catch (const std::runtime_error&) {
+        return false;
+    }
+
+    x = snapshots_.back();
+    for (int j = 0; j < r; ++j)
+        for (std::size_t i = 0; i < n; ++i)
+            x[i] += U[j][i] * y[j];
+
+    return true;
+}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+namespace dmd {
+
+    // Extrapolation of a linearly converging sequence (e.g. time steps
+    // settling on a steady state) to its limit by dynamic mode decomposition.
+    // The increments d_k = x_(k+1) - x_k of the stored window are assumed to
+    // evolve as d_(k+1) = A d_k; A is fitted in the span of the leading left
+    // singular vectors U of the increments, A ~ U At U^T, and the remaining
+    // increments are summed as a geometric series:
+    //   x_inf = x_m + U At (I - At)^-1 U^T d_(m-1)
+    // which requires every fitted mode to decay.
+    class Extrapolator {
+    public:
+        explicit Extrapolator(int window, double rank_tol = 1e-4);
+
+        void push(const std::vector<double>& x);
+        void clear() { snapshots_.clear(); }
+        bool empty() const { return snapshots_.empty(); }
+        bool full() const { return static_cast<int>(snapshots_.size()) == window_; }
+
+        // Writes the extrapolated limit into x. Returns false, leaving x
+        // untouched, when the window is not full or a fitted mode does not decay.
+        bool extrapolate(std::vector<double>& x) const;
+
+        double spectral_radius() const { return radius_; }   // Of the last fit
+
+    private:
+        int    window_ = 0;                 // Snapshots per fit [-]
+        double rank_tol_ = 0.0;             // Singular values below rank_tol * largest are dropped [-]
+        std::deque<std::vector<double>> snapshots_;
+        mutable double radius_ = 0.0;
+    };
+}
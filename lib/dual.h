@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <utility>
+
+// The operators are small and called per cell in the assembly loops; some
+// compilers stop inlining them in large translation units, which costs far
+// more than the arithmetic itself
+#if defined(_MSC_VER)
+#define DUAL_INLINE __forceinline
+#elif defined(__GNUC__)
+#define DUAL_INLINE inline __attribute__((always_inline))
+#else
+#define DUAL_INLINE inline
+#endif
+
+namespace dual {
+
+    // Forward-mode dual number carrying the derivatives of a value with
+    // respect to P parameters. Arithmetic propagates all P components at once;
+    // the component loops are unrolled at compile time (each), so every
+    // operation is straight-line code the compiler can vectorize. Comparisons
+    // look at the value only, so code branching on values (upwinding,
+    // limiters, convergence tests) takes the same path as with plain doubles
+    // and differentiates the branch it took.
+    template <int P>
+    struct Dual {
+        double v = 0.0;                     // Value
+        std::array<double, P> d{};          // Derivatives
+
+        Dual() = default;
+        DUAL_INLINE Dual(double value) : v(value) {}
+
+        // Calls f(k) for k = 0 .. P - 1, unrolled
+        template <typename F>
+        static DUAL_INLINE void each(F&& f) { each(f, std::make_integer_sequence<int, P>{}); }
+
+        template <typename F, int... K>
+        static DUAL_INLINE void each(F& f, std::integer_sequence<int, K...>) { (f(K), ...); }
+
+        DUAL_INLINE Dual& operator+=(const Dual& y) { v += y.v; each([&](int k) { d[k] += y.d[k]; }); return *this; }
+        DUAL_INLINE Dual& operator-=(const Dual& y) { v -= y.v; each([&](int k) { d[k] -= y.d[k]; }); return *this; }
+        DUAL_INLINE Dual& operator*=(const Dual& y) { *this = *this * y; return *this; }
+        DUAL_INLINE Dual& operator/=(const Dual& y) { *this = *this / y; return *this; }
+
+        friend DUAL_INLINE Dual operator+(const Dual& x) { return x; }
+
+        friend DUAL_INLINE Dual operator-(const Dual& x) {
+            Dual r;
+            r.v = -x.v;
+            each([&](int k) { r.d[k] = -x.d[k]; });
+            return r;
+        }
+
+        friend DUAL_INLINE Dual operator+(const Dual& x, const Dual& y) { Dual r = x; r += y; return r; }
+        friend DUAL_INLINE Dual operator-(const Dual& x, const Dual& y) { Dual r = x; r -= y; return r; }
+
+        friend DUAL_INLINE Dual operator*(const Dual& x, const Dual& y) {
+            Dual r;
+            r.v = x.v * y.v;
+            each([&](int k) { r.d[k] = x.d[k] * y.v + x.v * y.d[k]; });
+            return r;
+        }
+
+        friend DUAL_INLINE Dual operator/(const Dual& x, const Dual& y) {
+            Dual r;
+            r.v = x.v / y.v;
+            const double inv = 1.0 / y.v;
+            each([&](int k) { r.d[k] = (x.d[k] - r.v * y.d[k]) * inv; });
+            return r;
+        }
+
+        // Mixed operations skip the products with the zero derivatives of a double
+        friend DUAL_INLINE Dual operator+(const Dual& x, double y) { Dual r = x; r.v += y; return r; }
+        friend DUAL_INLINE Dual operator+(double x, const Dual& y) { Dual r = y; r.v += x; return r; }
+        friend DUAL_INLINE Dual operator-(const Dual& x, double y) { Dual r = x; r.v -= y; return r; }
+        friend DUAL_INLINE Dual operator-(double x, const Dual& y) { Dual r = -y; r.v += x; return r; }
+
+        friend DUAL_INLINE Dual operator*(const Dual& x, double y) {
+            Dual r;
+            r.v = x.v * y;
+            each([&](int k) { r.d[k] = x.d[k] * y; });
+            return r;
+        }
+        friend DUAL_INLINE Dual operator*(double x, const Dual& y) { return y * x; }
+        friend DUAL_INLINE Dual operator/(const Dual& x, double y) {
+            Dual r;
+            r.v = x.v / y;
+            each([&](int k) { r.d[k] = x.d[k] / y; });
+            return r;
+        }
+        friend DUAL_INLINE Dual operator/(double x, const Dual& y) {
+            Dual r;
+            r.v = x / y.v;
+            const double scale = -r.v / y.v;
+            each([&](int k) { r.d[k] = scale * y.d[k]; });
+            return r;
+        }
+
+        friend DUAL_INLINE bool operator<(const Dual& x, const Dual& y) { return x.v < y.v; }
+        friend DUAL_INLINE bool operator>(const Dual& x, const Dual& y) { return x.v > y.v; }
+        friend DUAL_INLINE bool operator<=(const Dual& x, const Dual& y) { return x.v <= y.v; }
+        friend DUAL_INLINE bool operator>=(const Dual& x, const Dual& y) { return x.v >= y.v; }
+    };
+
+    // Value and derivative access that also accepts plain doubles, so code
+    // templated over the scalar type can read values and seed parameters
+    DUAL_INLINE double value(double x) { return x; }
+    DUAL_INLINE double& value_ref(double& x) { return x; }
+
+    template <int P> DUAL_INLINE double value(const Dual<P>& x) { return x.v; }
+    template <int P> DUAL_INLINE double& value_ref(Dual<P>& x) { return x.v; }
+
+    template <int P> DUAL_INLINE double derivative(const Dual<P>& x, int k) { return x.d[k]; }
+
+    // A double carries no derivatives: seeding it is a no-op
+    DUAL_INLINE void seed(double&, int, double = 1.0) {}
+    template <int P> DUAL_INLINE void seed(Dual<P>& x, int k, double dx = 1.0) { x.d[k] = dx; }
+
+    DUAL_INLINE double abs(double x) { return std::abs(x); }
+    DUAL_INLINE double sqrt(double x) { return std::sqrt(x); }
+
+    template <int P>
+    DUAL_INLINE Dual<P> abs(const Dual<P>& x) { return x.v < 0.0 ? -x : x; }
+
+    template <int P>
+    DUAL_INLINE Dual<P> sqrt(const Dual<P>& x) {
+        Dual<P> r;
+        r.v = std::sqrt(x.v);
+        const double scale = 0.5 / r.v;
+        Dual<P>::each([&](int k) { r.d[k] = scale * x.d[k]; });
+        return r;
+    }
+}
@@ -0,0 +1,156 @@
+#include "live.h"
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace live {
+
+static constexpr std::uint32_t segment_magic = 0x4f534950;     // "PISO"
+static constexpr std::uint32_t segment_version = 1;
+
+Segment::Segment(const std::string& name, int n, bool create)
+    : name_(name), owner_(create)
+{
+    if (name.empty())
+        throw std::runtime_error("Live fields: empty segment name");
+
+    if (create) size_ = fields_offset + 3 * static_cast<std::size_t>(n) * sizeof(double);
+
+#ifdef _WIN32
+    const std::string path = "Local\\" + name;
+    HANDLE mapping = create
+        ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            static_cast<DWORD>(static_cast<unsigned long long>(size_) >> 32), static_cast<DWORD>(size_), path.c_str())
+        : OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, path.c_str());
+    if (mapping == nullptr)
+        throw std::runtime_error("Live fields: cannot open segment " + name);
+
+    data_ = MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size_);
+    mapping_ = mapping;
+#else
+    const std::string path = "/" + name;
+
+    // A segment left behind by a run that did not finish is replaced
+    if (create) shm_unlink(path.c_str());
+
+    const int fd = create
+        ? shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644)
+        : shm_open(path.c_str(), O_RDWR, 0);
+    if (fd < 0)
+        throw std::runtime_error("Live fields: cannot open segment " + name);
+
+    if (create && ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+        close(fd);
+        shm_unlink(path.c_str());
+        throw std::runtime_error("Live fields: cannot size segment " + name);
+    }
+
+    if (!create) {
+        struct stat info;
+        fstat(fd, &info);
+        size_ = static_cast<std::size_t>(info.st_size);
+    }
+
+    void* data = size_ >= fields_offset ? mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (data != MAP_FAILED) data_ = data;
+    close(fd);
+#endif
+
+    if (data_ == nullptr)
+        throw std::runtime_error("Live fields: cannot map segment " + name);
+
+    if (create) {
+        Header* header = new (data_) Header;
+        header->n = n;
+        header->version = segment_version;
+        header->magic = segment_magic;
+    }
+    else if (header().magic != segment_magic || header().version != segment_version)
+        throw std::runtime_error("Live fields: " + name + " is not a live field segment of this version");
+}
+
+Segment::~Segment() {
+#ifdef _WIN32
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(static_cast<HANDLE>(mapping_));
+#else
+    if (data_) munmap(data_, size_);
+    if (owner_) shm_unlink(("/" + name_).c_str());
+#endif
+}
+
+Publisher::Publisher(const std::string& name, int n)
+    : segment_(name, n, true), n_(n) {}
+
+void Publisher::publish(long long step, double time, const std::array<double, 3>& residuals,
+    const double* u, const double* p, const double* T)
+{
+    Header& header = segment_.header();
+    double* fields = segment_.fields();
+
+    const std::uint64_t sequence = header.sequence.load(std::memory_order_relaxed);
+
+    header.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    header.step = step;
+    header.time = time;
+    header.residuals = residuals;
+
+    std::memcpy(fields, u, n_ * sizeof(double));
+    std::memcpy(fields + n_, p, n_ * sizeof(double));
+    std::memcpy(fields + 2 * n_, T, n_ * sizeof(double));
+
+    header.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void Publisher::finish() {
+    segment_.header().finished.store(1, std::memory_order_release);
+}
+
+Reader::Reader(const std::string& name)
+    : segment_(name, 0, false) {}
+
+bool Reader::read(Snapshot& s) const {
+
+    const Header& header = segment_.header();
+    const double* fields = segment_.fields();
+    const int n = header.n;
+
+    s.u.resize(n);
+    s.p.resize(n);
+    s.T.resize(n);
+
+    while (true) {
+
+        const std::uint64_t before = header.sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;                       // Publish in progress
+
+        s.finished = header.finished.load(std::memory_order_acquire) != 0;
+        s.step = header.step;
+        s.time = header.time;
+        s.residuals = header.residuals;
+
+        std::memcpy(s.u.data(), fields, n * sizeof(double));
+        std::memcpy(s.p.data(), fields + n, n * sizeof(double));
+        std::memcpy(s.T.data(), fields + 2 * n, n * sizeof(double));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header.sequence.load(std::memory_order_relaxed) == before) break;
+    }
+
+    return s.step >= 0;
+}
+
+}
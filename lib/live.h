@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace live {
+
+    // Shared-memory segment holding the latest published fields of a run, for
+    // other processes on the same host. A header is followed by u, p and T,
+    // n doubles each. Updates are guarded by a sequence lock: the counter is
+    // odd while the solver writes, and a reader copying between two equal even
+    // values has a consistent snapshot. The solver never waits on readers;
+    // a reader that raced a publish simply copies again.
+    struct Header {
+        std::uint32_t magic = 0;
+        std::uint32_t version = 0;
+        std::int32_t  n = 0;                            // Cells [-]
+        std::atomic<std::uint32_t> finished{ 0 };       // Set once the run is over
+        std::atomic<std::uint64_t> sequence{ 0 };       // Odd while a publish is in progress
+
+        long long step = -1;                            // Time step of the fields, -1 before the first publish [-]
+        double time = 0.0;                              // Simulated time [s]
+        std::array<double, 3> residuals = {};           // Continuity, momentum, energy [-]
+    };
+
+    struct Snapshot {
+        long long step = -1;
+        double time = 0.0;
+        std::array<double, 3> residuals = {};
+        std::vector<double> u, p, T;
+        bool finished = false;
+    };
+
+    // Named mapping of the segment; "name" is the bare segment name
+    class Segment {
+    public:
+        Segment(const std::string& name, int n, bool create);
+        ~Segment();
+
+        Segment(const Segment&) = delete;
+        Segment& operator=(const Segment&) = delete;
+
+        Header& header() const { return *static_cast<Header*>(data_); }
+        double* fields() const { return reinterpret_cast<double*>(static_cast<char*>(data_) + fields_offset); }
+
+        static constexpr std::size_t fields_offset = (sizeof(Header) + 63) / 64 * 64;
+
+    private:
+        std::string name_;
+        bool owner_ = false;
+        void* data_ = nullptr;
+        std::size_t size_ = 0;
+        void* mapping_ = nullptr;           // Platform mapping handle
+    };
+
+    // Solver side: creates the segment, removed again when destroyed
+    class Publisher {
+    public:
+        Publisher(const std::string& name, int n);
+
+        // Copies the fields in: one memcpy per field between the two counter updates
+        void publish(long long step, double time, const std::array<double, 3>& residuals,
+            const double* u, const double* p, const double* T);
+
+        void finish();
+
+    private:
+        Segment segment_;
+        int n_ = 0;
+    };
+
+    // Reader side: opens an existing segment
+    class Reader {
+    public:
+        explicit Reader(const std::string& name);
+
+        int cells() const { return segment_.header().n; }
+
+        // Latest consistent snapshot into `s`, its vectors sized once. False
+        // if nothing has been published yet.
+        bool read(Snapshot& s) const;
+
+    private:
+        Segment segment_;
+    };
+}
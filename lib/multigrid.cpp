@@ -0,0 +1,171 @@
+#include "multigrid.h"
+
+#include <algorithm>
+
+namespace multigrid {
+
+namespace {
+
+    int factor(int n) { return n >= 4 ? 2 : 1; }
+
+    bool uncoupled(const adi::Stencil& s, int p) {
+        return s.aW[p] == 0.0 && s.aE[p] == 0.0 && s.aS[p] == 0.0 && s.aN[p] == 0.0;
+    }
+
+    // Linear interpolation weights along one direction: fine cell i lies a
+    // quarter of a coarse cell from the centre of coarse cell i / f, towards
+    // `other`, which is the coarse cell itself at the ends of the grid
+    void weights(int i, int f, int nc, int& own, int& other, double& w_own) {
+
+        own = other = i / f;
+        w_own = 1.0;
+
+        if (f == 1) return;
+
+        const int o = i % 2 == 0 ? own - 1 : own + 1;
+        if (o < 0 || o >= nc) return;
+
+        other = o;
+        w_own = 0.75;
+    }
+
+    // Sums the equations of the fine cells into their coarse cells. Links
+    // inside a coarse cell cancel against its diagonal. A summed link across
+    // a coarse face spans twice the distance of the fine ones, so it is
+    // scaled by the inverse coarsening factor of its direction, the diagonal
+    // following; for a diffusion operator this is the five-point stencil of
+    // the coarse grid, where the plain sums over-estimate it and halve every
+    // correction.
+    void coarsen(const adi::Stencil& f, adi::Stencil& c) {
+
+        const int fz = factor(f.nz), fr = factor(f.nr);
+        const double sz = 1.0 / fz, sr = 1.0 / fr;
+
+        c.resize((f.nz + fz - 1) / fz, (f.nr + fr - 1) / fr);
+
+        for (int j = 0; j < f.nr; ++j) {
+            for (int i = 0; i < f.nz; ++i) {
+
+                const int p = j * f.nz + i;
+                const int I = i / fz, J = j / fr;
+                const int P = J * c.nz + I;
+
+                if (uncoupled(f, p)) continue;
+
+                double aP = f.aP[p];
+
+                if (i > 0) {
+                    aP -= f.aW[p];
+                    if ((i - 1) / fz != I) { c.aW[P] += sz * f.aW[p]; aP += sz * f.aW[p]; }
+                }
+                if (i < f.nz - 1) {
+                    aP -= f.aE[p];
+                    if ((i + 1) / fz != I) { c.aE[P] += sz * f.aE[p]; aP += sz * f.aE[p]; }
+                }
+                if (j > 0) {
+                    aP -= f.aS[p];
+                    if ((j - 1) / fr != J) { c.aS[P] += sr * f.aS[p]; aP += sr * f.aS[p]; }
+                }
+                if (j < f.nr - 1) {
+                    aP -= f.aN[p];
+                    if ((j + 1) / fr != J) { c.aN[P] += sr * f.aN[p]; aP += sr * f.aN[p]; }
+                }
+
+                c.aP[P] += aP;
+            }
+        }
+
+        // Coarse cells made of uncoupled rows only stay uncoupled
+        for (double& aP : c.aP)
+            if (aP == 0.0) aP = 1.0;
+    }
+}
+
+void Hierarchy::build(const adi::Stencil& s) {
+
+    fine = &s;
+
+    int levels = 0;
+    int nz = s.nz, nr = s.nr;
+
+    while (nz * nr > coarsest_cells && (factor(nz) > 1 || factor(nr) > 1)) {
+        nz = (nz + factor(nz) - 1) / factor(nz);
+        nr = (nr + factor(nr) - 1) / factor(nr);
+        ++levels;
+    }
+
+    coarse.resize(levels);
+    x.resize(levels);
+    r.resize(levels);
+    work.resize(levels + 1);
+
+    for (int l = 0; l < levels; ++l) {
+        coarsen(level(l), coarse[l]);
+        x[l].assign(coarse[l].aP.size(), 0.0);
+    }
+}
+
+void Hierarchy::solve(std::vector<double>& x0) {
+    visit(0, x0);
+}
+
+void Hierarchy::visit(int l, std::vector<double>& xl) {
+
+    const adi::Stencil& A = level(l);
+
+    if (l == static_cast<int>(coarse.size())) {
+        adi::relax(A, xl, coarsest_sweeps, work[l]);
+        return;
+    }
+
+    adi::relax(A, xl, pre_sweeps, work[l]);
+
+    adi::Stencil& C = coarse[l];
+    std::vector<double>& dx = x[l];
+
+    // A W-cycle visits the next level twice (once when it is the coarsest)
+    const int visits = cycle == Cycle::W && l + 1 < static_cast<int>(coarse.size()) ? 2 : 1;
+    const int fz = factor(A.nz), fr = factor(A.nr);
+
+    for (int v = 0; v < visits; ++v) {
+
+        // Restriction: the coarse right-hand side is the summed fine residual
+        adi::residuals(A, xl, r[l]);
+        std::fill(C.b.begin(), C.b.end(), 0.0);
+
+        for (int j = 0; j < A.nr; ++j)
+            for (int i = 0; i < A.nz; ++i)
+                if (!uncoupled(A, j * A.nz + i))
+                    C.b[(j / fr) * C.nz + i / fz] += r[l][j * A.nz + i];
+
+        std::fill(dx.begin(), dx.end(), 0.0);
+        visit(l + 1, dx);
+
+        // Prolongation: bilinear interpolation between the coarse centres
+        for (int j = 0; j < A.nr; ++j) {
+
+            int J0, J1;
+            double wr;
+            weights(j, fr, C.nr, J0, J1, wr);
+
+            for (int i = 0; i < A.nz; ++i) {
+
+                if (uncoupled(A, j * A.nz + i)) continue;
+
+                int I0, I1;
+                double wz;
+                weights(i, fz, C.nz, I0, I1, wz);
+
+                xl[j * A.nz + i] +=
+                    + wz * wr * dx[J0 * C.nz + I0]
+                    + (1.0 - wz) * wr * dx[J0 * C.nz + I1]
+                    + wz * (1.0 - wr) * dx[J1 * C.nz + I0]
+                    + (1.0 - wz) * (1.0 - wr) * dx[J1 * C.nz + I1];
+            }
+        }
+    }
+
+    adi::relax(A, xl, post_sweeps, work[l]);
+}
+
+}
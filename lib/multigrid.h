@@ -0,0 +1,44 @@
+#pragma once
+
+#include "adi.h"
+
+#include <vector>
+
+namespace multigrid {
+
+    enum class Cycle { V, W };
+
+    // Cell-centred geometric multigrid for five-point systems. Each coarse
+    // cell merges up to 2 x 2 cells of the next finer grid (directions with
+    // fewer than 4 cells are not coarsened). Residuals are restricted by
+    // summation, corrections prolongated by bilinear interpolation, and the
+    // coarse equations are the summed fine ones with the links rescaled to the
+    // coarse spacing. ADI line relaxation smooths on every level; the coarsest
+    // one is relaxed to convergence. Rows without couplings (eliminated boundary
+    // nodes) take no part in the coarse grids.
+    struct Hierarchy {
+
+        Cycle cycle = Cycle::V;
+        int   pre_sweeps = 1;               // Smoothing sweeps before restriction [-]
+        int   post_sweeps = 1;              // Smoothing sweeps after prolongation [-]
+        int   coarsest_cells = 64;          // Coarsening stops below this size [-]
+        int   coarsest_sweeps = 10;         // Relaxation sweeps on the coarsest grid [-]
+
+        const adi::Stencil* fine = nullptr;
+        std::vector<adi::Stencil> coarse;           // Level l + 1, b holds the restricted residual
+        std::vector<std::vector<double>> x;         // Corrections of the coarse levels
+        std::vector<std::vector<double>> r;         // Residuals of the levels that have a coarser one
+        std::vector<adi::Workspace> work;           // Line coefficients of every level
+
+        // Coarse operators of `s`, which must outlive the hierarchy's use.
+        // Storage is reused when the grid size is unchanged.
+        void build(const adi::Stencil& s);
+
+        // One cycle on the fine system, x holding the initial guess
+        void solve(std::vector<double>& x0);
+
+    private:
+        const adi::Stencil& level(int l) const { return l == 0 ? *fine : coarse[l - 1]; }
+        void visit(int l, std::vector<double>& xl);
+    };
+}
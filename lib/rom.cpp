@@ -0,0 +1,179 @@
+#include "rom.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace rom {
+
+namespace {
+
+    double dot(const std::vector<double>& x, const std::vector<double>& y) {
+        double s = 0.0;
+        for (std::size_t i = 0; i < x.size(); ++i) s += x[i] * y[i];
+        return s;
+    }
+}
+
+void svd(std::vector<std::vector<double>>& columns, std::vector<double>& sigma) {
+
+    const int m = static_cast<int>(columns.size());
+    const double eps = 1e-15;
+
+    for (int sweep = 0; sweep < 60; ++sweep) {
+
+        bool rotated = false;
+
+        for (int p = 0; p < m - 1; ++p) {
+            for (int q = p + 1; q < m; ++q) {
+
+                std::vector<double>& x = columns[p];
+                std::vector<double>& y = columns[q];
+
+                const double alpha = dot(x, x);
+                const double beta = dot(y, y);
+                const double gamma = dot(x, y);
+
+                if (std::abs(gamma) <= eps * std::sqrt(alpha * beta)) continue;
+
+                // Rotation zeroing the inner product of the pair
+                const double zeta = (beta - alpha) / (2.0 * gamma);
+                const double t = (zeta >= 0.0 ? 1.0 : -1.0) / (std::abs(zeta) + std::sqrt(1.0 + zeta * zeta));
+                const double c = 1.0 / std::sqrt(1.0 + t * t);
+                const double s = c * t;
+
+                for (std::size_t i = 0; i < x.size(); ++i) {
+                    const double xi = x[i];
+                    x[i] = c * xi - s * y[i];
+                    y[i] = s * xi + c * y[i];
+                }
+
+                rotated = true;
+            }
+        }
+
+        if (!rotated) break;
+    }
+
+    sigma.resize(m);
+    for (int k = 0; k < m; ++k) sigma[k] = std::sqrt(dot(columns[k], columns[k]));
+
+    std::vector<int> order(m);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return sigma[a] > sigma[b]; });
+
+    const double cutoff = m > 0 ? 1e-13 * sigma[order[0]] : 0.0;
+
+    std::vector<std::vector<double>> u(m);
+    std::vector<double> s(m);
+
+    for (int k = 0; k < m; ++k) {
+
+        u[k] = std::move(columns[order[k]]);
+        s[k] = sigma[order[k]];
+
+        if (s[k] <= cutoff) {
+            std::fill(u[k].begin(), u[k].end(), 0.0);
+            s[k] = 0.0;
+        }
+        else
+            for (double& value : u[k]) value /= s[k];
+    }
+
+    columns = std::move(u);
+    sigma = std::move(s);
+}
+
+std::vector<double> Basis::project(const std::vector<double>& x) const {
+
+    std::vector<double> a(modes.size());
+
+    for (std::size_t k = 0; k < modes.size(); ++k) {
+        double s = 0.0;
+        for (std::size_t i = 0; i < x.size(); ++i) s += modes[k][i] * (x[i] - mean[i]);
+        a[k] = s;
+    }
+
+    return a;
+}
+
+void Basis::expand(const std::vector<double>& a, int offset, std::vector<double>& x) const {
+
+    x = mean;
+
+    for (std::size_t k = 0; k < modes.size(); ++k)
+        for (std::size_t i = 0; i < x.size(); ++i)
+            x[i] += a[offset + k] * modes[k][i];
+}
+
+Basis pod(const std::vector<std::vector<double>>& snapshots, double tol) {
+
+    if (snapshots.empty())
+        throw std::runtime_error("POD: no snapshots");
+
+    const std::size_t n = snapshots[0].size();
+
+    Basis basis;
+    basis.mean.assign(n, 0.0);
+
+    for (const std::vector<double>& x : snapshots)
+        for (std::size_t i = 0; i < n; ++i)
+            basis.mean[i] += x[i] / snapshots.size();
+
+    std::vector<std::vector<double>> columns;
+    for (const std::vector<double>& x : snapshots) {
+        columns.push_back(x);
+        for (std::size_t i = 0; i < n; ++i) columns.back()[i] -= basis.mean[i];
+    }
+
+    std::vector<double> sigma;
+    svd(columns, sigma);
+
+    double energy = 0.0;
+    for (double s : sigma) energy += s * s;
+
+    // Smallest basis whose discarded tail stays below the tolerance
+    double tail = energy;
+    for (std::size_t k = 0; k < sigma.size() && sigma[k] > 0.0 && tail > tol * energy; ++k) {
+        basis.modes.push_back(std::move(columns[k]));
+        basis.sigma.push_back(sigma[k]);
+        tail -= sigma[k] * sigma[k];
+    }
+
+    return basis;
+}
+
+std::vector<double> solve_dense(std::vector<double> A, std::vector<double> b, int n) {
+
+    for (int k = 0; k < n; ++k) {
+
+        int pivot = k;
+        for (int i = k + 1; i < n; ++i)
+            if (std::abs(A[i * n + k]) > std::abs(A[pivot * n + k])) pivot = i;
+
+        if (A[pivot * n + k] == 0.0)
+            throw std::runtime_error("Dense solve: singular matrix");
+
+        if (pivot != k) {
+            for (int j = 0; j < n; ++j) std::swap(A[k * n + j], A[pivot * n + j]);
+            std::swap(b[k], b[pivot]);
+        }
+
+        for (int i = k + 1; i < n; ++i) {
+            const double m = A[i * n + k] / A[k * n + k];
+            for (int j = k; j < n; ++j) A[i * n + j] -= m * A[k * n + j];
+            b[i] -= m * b[k];
+        }
+    }
+
+    for (int k = n - 1; k >= 0; --k) {
+        double s = b[k];
+        for (int j = k + 1; j < n; ++j) s -= A[k * n + j] * b[j];
+        b[k] = s / A[k * n + k];
+    }
+
+    return b;
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+namespace rom {
+
+    // Thin SVD of the matrix whose columns are `columns` (all of the same
+    // length) by one-sided Jacobi rotations: pairs of columns are rotated until
+    // they are mutually orthogonal, their norms then being the singular values.
+    // On exit `columns` holds the left singular vectors, sorted by decreasing
+    // singular value; columns of a rank-deficient matrix come back as zero
+    // vectors with zero singular values.
+    void svd(std::vector<std::vector<double>>& columns, std::vector<double>& sigma);
+
+    // Proper orthogonal decomposition of a snapshot set: x ~ mean + sum(a_k phi_k)
+    // with orthonormal modes phi_k, most energetic first
+    struct Basis {
+        std::vector<double> mean;                   // Snapshot average
+        std::vector<std::vector<double>> modes;     // Orthonormal modes
+        std::vector<double> sigma;                  // Singular value of every mode
+
+        int size() const { return static_cast<int>(modes.size()); }
+
+        // Reduced coordinates of x (orthogonal projection onto the modes)
+        std::vector<double> project(const std::vector<double>& x) const;
+
+        // mean + sum(a[offset + k] phi_k)
+        void expand(const std::vector<double>& a, int offset, std::vector<double>& x) const;
+    };
+
+    // Modes of the snapshots about their mean, dropping the trailing modes
+    // that together carry less than a fraction `tol` of the fluctuation energy
+    // (sum of squared singular values)
+    Basis pod(const std::vector<std::vector<double>>& snapshots, double tol);
+
+    // Solves the dense n x n system A x = b (A row-major) by Gaussian
+    // elimination with partial pivoting. Throws on a singular matrix.
+    std::vector<double> solve_dense(std::vector<double> A, std::vector<double> b, int n);
+}
@@ -0,0 +1,97 @@
+#include "sources.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace sources {
+
+std::vector<Zone> cells_in(
+    double z_start, double z_end,
+    int N, double dz,
+    const std::vector<Zone>& taken)
+{
+    std::vector<bool> free(N, true);
+    for (const Zone& zone : taken)
+        for (int i = zone.begin; i < zone.end; ++i)
+            free[i] = false;
+
+    std::vector<Zone> zones;
+
+    for (int i = 0; i < N; ++i) {
+
+        const double z = (i + 0.5) * dz;
+        const bool inside = free[i] && z >= z_start && z <= z_end;
+
+        if (!inside) continue;
+
+        if (!zones.empty() && zones.back().end == i)
+            zones.back().end = i + 1;
+        else {
+            Zone zone;
+            zone.begin = i;
+            zone.end = i + 1;
+            zones.push_back(zone);
+        }
+    }
+
+    return zones;
+}
+
+std::vector<double> profile(const std::string& filename, int cells) {
+
+    std::ifstream file(filename);
+    if (!file)
+        throw std::runtime_error("Sources: profile file not found: " + filename);
+
+    std::vector<double> xi, w;
+    std::string line;
+
+    while (std::getline(file, line)) {
+
+        auto comment = line.find('#');
+        if (comment != std::string::npos)
+            line = line.substr(0, comment);
+
+        std::istringstream row(line);
+        double x, y;
+        if (row >> x >> y) {
+            xi.push_back(x);
+            w.push_back(y);
+        }
+    }
+
+    if (xi.empty())
+        throw std::runtime_error("Sources: empty profile file: " + filename);
+
+    // Piecewise-linear interpolation at the cell centres, constant outside the table
+    std::vector<double> shape(cells);
+    double mean = 0.0;
+
+    for (int i = 0; i < cells; ++i) {
+
+        const double x = (i + 0.5) / cells;
+        const auto it = std::upper_bound(xi.begin(), xi.end(), x);
+
+        if (it == xi.begin()) shape[i] = w.front();
+        else if (it == xi.end()) shape[i] = w.back();
+        else {
+            const std::size_t j = it - xi.begin();
+            const double s = (x - xi[j - 1]) / (xi[j] - xi[j - 1]);
+            shape[i] = (1.0 - s) * w[j - 1] + s * w[j];
+        }
+
+        mean += shape[i] / cells;
+    }
+
+    if (mean == 0.0)
+        throw std::runtime_error("Sources: profile with zero mean: " + filename);
+
+    for (double& value : shape) value /= mean;
+
+    return shape;
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sources {
+
+    // Contiguous cells [begin, end) carrying volumetric sources. The strengths
+    // are zone constants, optionally shaped by a per-cell profile of unit mean.
+    // Real is the type of the strengths (a dual number for sensitivities).
+    template <typename Real>
+    struct BasicZone {
+        int begin = 0;
+        int end = 0;
+        Real S_m = 0.0;                     // Volumetric mass source [kg/(m3 s)]
+        Real S_h = 0.0;                     // Volumetric heat source [W/m3]
+        std::vector<double> profile;        // Shape over the zone cells, empty if uniform [-]
+
+        Real mass(int i) const { return profile.empty() ? S_m : S_m * profile[i - begin]; }
+        Real heat(int i) const { return profile.empty() ? S_h : S_h * profile[i - begin]; }
+    };
+
+    using Zone = BasicZone<double>;
+
+    // Piece of a cell range that is either free of sources (zone = -1) or
+    // lies inside a single zone
+    struct Segment {
+        int begin = 0;
+        int end = 0;
+        int zone = -1;
+    };
+
+    // Zones of the cells whose centres fall in [z_start, z_end], skipping the
+    // cells already taken by the zones in `taken`
+    std::vector<Zone> cells_in(
+        double z_start, double z_end,
+        int N, double dz,
+        const std::vector<Zone>& taken
+    );
+
+    // Splits [first, last) into source-free and source-bearing segments
+    template <typename Real>
+    std::vector<Segment> segments(
+        const std::vector<BasicZone<Real>>& zones,
+        int first, int last)
+    {
+        std::vector<std::pair<int, int>> order;        // (begin, zone index)
+        for (int z = 0; z < static_cast<int>(zones.size()); ++z)
+            order.push_back({ zones[z].begin, z });
+        std::sort(order.begin(), order.end());
+
+        std::vector<Segment> result;
+        int i = first;
+
+        for (const auto& entry : order) {
+
+            const BasicZone<Real>& zone = zones[entry.second];
+            const int begin = std::max(zone.begin, first);
+            const int end = std::min(zone.end, last);
+
+            if (begin >= end) continue;
+            if (begin < i)
+                throw std::runtime_error("Sources: overlapping zones");
+
+            if (begin > i) result.push_back({ i, begin, -1 });
+            result.push_back({ begin, end, entry.second });
+            i = end;
+        }
+
+        if (i < last) result.push_back({ i, last, -1 });
+
+        return result;
+    }
+
+    // Samples a profile file ("xi weight" per line, xi in [0, 1] along the zone)
+    // on the zone cells and normalizes it to unit mean
+    std::vector<double> profile(const std::string& filename, int cells);
+}
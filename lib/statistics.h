@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace statistics {
+
+    // Per-cell running mean, variance (Welford's update), minimum and maximum
+    // of a field sampled once per time step. The cells share the sample count:
+    // a sample is opened once (next) and then added cell by cell, so the
+    // update can ride along an existing pass over the field.
+    struct Running {
+        std::vector<double> mean, m2, min, max;
+        long long count = 0;
+        double inv_count = 0.0;
+
+        void resize(int n) {
+            mean.assign(n, 0.0);
+            m2.assign(n, 0.0);
+            min.assign(n, std::numeric_limits<double>::max());
+            max.assign(n, std::numeric_limits<double>::lowest());
+            count = 0;
+        }
+
+        void next() { inv_count = 1.0 / ++count; }
+
+        void add(int i, double x) {
+            const double delta = x - mean[i];
+            mean[i] += delta * inv_count;
+            m2[i] += delta * (x - mean[i]);
+            min[i] = std::min(min[i], x);
+            max[i] = std::max(max[i], x);
+        }
+
+        // Variance of the sampled series about its mean, and its root: the RMS
+        // of the fluctuation
+        double variance(int i) const { return count > 0 ? m2[i] / count : 0.0; }
+        double rms(int i) const { return std::sqrt(variance(i)); }
+    };
+}
@@ -1,35 +1,109 @@
 #include "tdma.h"
 
+#include <cmath>
 #include <stdexcept>
+#include <string>
 
 namespace tdma {
 
-std::vector<double> solve(
+void solve_batched(
     const std::vector<double>& a,
     const std::vector<double>& b,
     const std::vector<double>& c,
-    const std::vector<double>& d)
+    std::vector<double>& d,
+    int n, int count,
+    int row_stride, int system_stride,
+    int offset)
 {
-    const int n = b.size();
-    if (a.size()!=n || c.size()!=n || d.size()!=n)
+    if (count <= 0 || n <= 0) return;
+
+    const std::size_t last = static_cast<std::size_t>(offset)
+        + static_cast<std::size_t>(count - 1) * system_stride
+        + static_cast<std::size_t>(n - 1) * row_stride;
+    if (a.size() <= last || b.size() <= last || c.size() <= last || d.size() <= last)
         throw std::runtime_error("TDMA: size mismatch");
 
-    std::vector<double> c_star(n), d_star(n), x(n);
+    #pragma omp parallel if (count > 1)
+    {
+        std::vector<double> c_star(n);
+
+        #pragma omp for schedule(static)
+        for (int s = 0; s < count; ++s) {
+
+            const std::size_t o = static_cast<std::size_t>(offset)
+                + static_cast<std::size_t>(s) * system_stride;
 
-    c_star[0] = c[0] / b[0];
-    d_star[0] = d[0] / b[0];
+            c_star[0] = c[o] / b[o];
+            d[o] = d[o] / b[o];
 
-    for (int i = 1; i < n; ++i) {
-        const double m = b[i] - a[i] * c_star[i - 1];
-        c_star[i] = c[i] / m;
-        d_star[i] = (d[i] - a[i] * d_star[i - 1]) / m;
+            for (int k = 1; k < n; ++k) {
+                const std::size_t i = o + static_cast<std::size_t>(k) * row_stride;
+                const double m = b[i] - a[i] * c_star[k - 1];
+                c_star[k] = c[i] / m;
+                d[i] = (d[i] - a[i] * d[i - row_stride]) / m;
+            }
+
+            for (int k = n - 2; k >= 0; --k) {
+                const std::size_t i = o + static_cast<std::size_t>(k) * row_stride;
+                d[i] = d[i] - c_star[k] * d[i + row_stride];
+            }
+        }
     }
+}
+
+void check_banded_solves() {
+
+    auto fail = [](const std::string& what, int n, int edge, bool broken) {
+        throw std::logic_error("TDMA check: " + what + " differs from solve() for n = " + std::to_string(n)
+            + ", edge = " + std::to_string(edge) + (broken ? ", broken band" : ""));
+    };
+
+    for (int n : { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 40, 401 }) {
+        for (int edge = 0; edge <= 3; ++edge) {
+            for (bool broken : { false, true }) {
+
+                // Symmetric, with alike rows [edge, n - edge) whose pivots
+                // settle within a few rows, and edge rows of their own
+                std::vector<double> a(n, -1e-3), b(n, 2.0), c(n, -1e-3), d(n);
 
-    x[n - 1] = d_star[n - 1];
-    for (int i = n - 2; i >= 0; --i)
-        x[i] = d_star[i] - c_star[i] * x[i + 1];
+                for (int i = 0; i < n; ++i) {
+                    if (i < edge || i >= n - edge) b[i] = 1.0 + 0.25 * i;
+                    d[i] = std::sin(i + 1.0);
+                }
+                if (broken) b[n / 2] += 0.5;
 
-    return x;
+                a[0] = 0.0;
+                c[n - 1] = 0.0;
+
+                const std::vector<double> x = solve(a, b, c, d);
+
+                double scale = 0.0;
+                for (double v : x) scale = std::max(scale, std::abs(v));
+
+                auto close = [&](const std::vector<double>& y) {
+                    for (int i = 0; i < n; ++i)
+                        if (!(std::abs(y[i] - x[i]) <= 1e-13 * scale)) return false;
+                    return true;
+                };
+
+                Toeplitz<double> t;
+                t.build(a, b, c, edge);
+                if (!t.matches(a, b, c)) fail("Toeplitz::matches", n, edge, broken);
+
+                std::vector<double> y = d;
+                t.solve(y);
+                if (!close(y)) fail("Toeplitz::solve", n, edge, broken);
+
+                Symmetric<double> A;
+                A.diag = b;
+                A.off.assign(c.begin(), c.end() - 1);
+
+                y = d;
+                solve(factor(A), y);
+                if (!close(y)) fail("LDL^T solve", n, edge, broken);
+            }
+        }
+    }
 }
 
 }
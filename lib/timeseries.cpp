@@ -0,0 +1,148 @@
+#include "timeseries.h"
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace timeseries {
+
+Series::Series(const std::string& filename)
+    : filename_(filename)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Time series: cannot open " + filename);
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    size_ = static_cast<std::size_t>(size.QuadPart);
+
+    if (size_ > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            data_ = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            mapping_ = mapping;
+        }
+    }
+    CloseHandle(file);
+#else
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Time series: cannot open " + filename);
+
+    struct stat info;
+    fstat(fd, &info);
+    size_ = static_cast<std::size_t>(info.st_size);
+
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) data_ = static_cast<const char*>(data);
+    }
+    close(fd);
+#endif
+
+    if (data_ == nullptr)
+        throw std::runtime_error("Time series: cannot map " + filename);
+
+    rewind();
+
+    if (!has_next_)
+        throw std::runtime_error("Time series: no samples in " + filename);
+}
+
+Series::~Series() {
+#ifdef _WIN32
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(static_cast<HANDLE>(mapping_));
+#else
+    if (data_) munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+void Series::rewind() {
+
+    cursor_ = 0;
+    has_next_ = next_sample(t1_, v1_);
+
+    // Hold the first value before the start of the table
+    t0_ = t1_;
+    v0_ = v1_;
+}
+
+bool Series::next_sample(double& t, double& value) {
+
+    while (cursor_ < size_) {
+
+        const char* line = data_ + cursor_;
+        const char* eol = static_cast<const char*>(std::memchr(line, '\n', size_ - cursor_));
+        const char* end = eol ? eol : data_ + size_;
+
+        cursor_ = (eol ? eol + 1 : end) - data_;
+
+        // Removes comments
+        const char* comment = static_cast<const char*>(std::memchr(line, '#', end - line));
+        if (comment) end = comment;
+
+        auto skip = [end](const char* c) {
+            while (c < end && (*c == ' ' || *c == '\t' || *c == ',' || *c == '\r')) ++c;
+            return c;
+        };
+
+        const char* c = skip(line);
+        if (c == end) continue;                             // Empty line
+
+        auto first = std::from_chars(c, end, t);
+        if (first.ec != std::errc())
+            throw std::runtime_error("Time series: malformed line in " + filename_);
+
+        c = skip(first.ptr);
+        auto second = std::from_chars(c, end, value);
+        if (second.ec != std::errc())
+            throw std::runtime_error("Time series: malformed line in " + filename_);
+
+        return true;
+    }
+
+    return false;
+}
+
+double Series::at(double t) {
+
+    if (t < t0_) rewind();
+
+    // Advance the cursor until the samples bracket t
+    while (has_next_ && t >= t1_) {
+
+        t0_ = t1_;
+        v0_ = v1_;
+
+        double t_next, v_next;
+        has_next_ = next_sample(t_next, v_next);
+
+        if (has_next_) {
+            if (t_next <= t0_)
+                throw std::runtime_error("Time series: times not increasing in " + filename_);
+            t1_ = t_next;
+            v1_ = v_next;
+        }
+    }
+
+    if (!has_next_ || t <= t0_) return v0_;
+
+    const double s = (t - t0_) / (t1_ - t0_);
+    return (1.0 - s) * v0_ + s * v1_;
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace timeseries {
+
+    // Piecewise-linear signal tabulated in a text file, one "t value" pair per
+    // line with t increasing ('#' starts a comment, ',' may separate columns).
+    // The file is memory-mapped and parsed lazily: a cursor keeps the bracketing
+    // pair of samples and only advances as far as the requested time, so a run
+    // evaluating the signal at non-decreasing times costs O(1) per step and a
+    // long signal is never parsed up front. Going back in time rewinds the
+    // cursor. Before the first and after the last sample the signal is held
+    // constant.
+    class Series {
+    public:
+        explicit Series(const std::string& filename);
+        ~Series();
+
+        Series(const Series&) = delete;
+        Series& operator=(const Series&) = delete;
+
+        double at(double t);
+
+    private:
+        bool next_sample(double& t, double& value);
+        void rewind();
+
+        std::string filename_;
+
+        const char* data_ = nullptr;        // Mapped file contents
+        std::size_t size_ = 0;              // Mapped file size [bytes]
+        std::size_t cursor_ = 0;            // Offset of the first unparsed line [bytes]
+
+        double t0_ = 0.0, v0_ = 0.0;        // Last sample at or before the current time
+        double t1_ = 0.0, v1_ = 0.0;        // First sample after it
+        bool   has_next_ = false;           // t1_/v1_ valid, false past the end of the table
+
+        void*  mapping_ = nullptr;          // Platform mapping handle
+    };
+}
@@ -0,0 +1,320 @@
+#include "uq.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace uq {
+
+double Distribution::map(double xi) const {
+
+    if (family == Family::uniform) return 0.5 * (a + b) + 0.5 * (b - a) * xi;
+    return a + b * xi;
+}
+
+Distribution Distribution::parse(const std::string& text) {
+
+    std::istringstream in(text);
+    std::string name;
+    Distribution d;
+
+    if (!(in >> name >> d.a >> d.b))
+        throw std::runtime_error("UQ: distribution must read \"uniform a b\" or \"normal mean sd\": " + text);
+
+    if (name == "uniform") d.family = Family::uniform;
+    else if (name == "normal") d.family = Family::normal;
+    else throw std::runtime_error("UQ: unknown distribution " + name);
+
+    if (d.family == Family::uniform && !(d.b > d.a))
+        throw std::runtime_error("UQ: uniform distribution needs a < b");
+    if (d.family == Family::normal && !(d.b > 0.0))
+        throw std::runtime_error("UQ: normal distribution needs a positive standard deviation");
+
+    return d;
+}
+
+// Eigenvalues and first eigenvector components of the symmetric tridiagonal
+// Jacobi matrix (zero diagonal, off-diagonal `beta`) by cyclic Jacobi rotations
+static void jacobi_eigen(const std::vector<double>& beta, std::vector<double>& lambda, std::vector<double>& v0) {
+
+    const int n = static_cast<int>(beta.size()) + 1;
+
+    std::vector<double> A(n * n, 0.0), V(n * n, 0.0);
+    for (int i = 0; i < n; ++i) V[i * n + i] = 1.0;
+    for (int i = 0; i + 1 < n; ++i) A[i * n + i + 1] = A[(i + 1) * n + i] = beta[i];
+
+    for (int sweep = 0; sweep < 100; ++sweep) {
+
+        double off = 0.0;
+        for (int i = 0; i < n; ++i)
+            for (int j = i + 1; j < n; ++j) off += A[i * n + j] * A[i * n + j];
+        if (off < 1e-30) break;
+
+        for (int p = 0; p < n; ++p)
+            for (int q = p + 1; q < n; ++q) {
+
+                const double apq = A[p * n + q];
+                if (std::abs(apq) < 1e-300) continue;
+
+                const double theta = (A[q * n + q] - A[p * n + p]) / (2.0 * apq);
+                const double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                const double c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+
+                for (int k = 0; k < n; ++k) {
+                    const double akp = A[k * n + p], akq = A[k * n + q];
+                    A[k * n + p] = c * akp - s * akq;
+                    A[k * n + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < n; ++k) {
+                    const double apk = A[p * n + k], aqk = A[q * n + k];
+                    A[p * n + k] = c * apk - s * aqk;
+                    A[q * n + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < n; ++k) {
+                    const double vkp = V[k * n + p], vkq = V[k * n + q];
+                    V[k * n + p] = c * vkp - s * vkq;
+                    V[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+    }
+
+    lambda.resize(n);
+    v0.resize(n);
+    for (int i = 0; i < n; ++i) {
+        lambda[i] = A[i * n + i];
+        v0[i] = V[i];
+    }
+}
+
+Rule gauss(Family family, int n) {
+
+    if (n < 1) throw std::runtime_error("UQ: a Gauss rule needs at least one point");
+
+    Rule rule;
+
+    if (n == 1) {
+        rule.x = { 0.0 };
+        rule.w = { 1.0 };
+        return rule;
+    }
+
+    // Three-term recurrence of the orthonormal polynomials
+    std::vector<double> beta(n - 1);
+    for (int k = 1; k < n; ++k)
+        beta[k - 1] = family == Family::uniform ? k / std::sqrt(4.0 * k * k - 1.0) : std::sqrt(static_cast<double>(k));
+
+    std::vector<double> lambda, v0;
+    jacobi_eigen(beta, lambda, v0);
+
+    std::vector<std::pair<double, double>> nodes(n);
+    for (int i = 0; i < n; ++i) nodes[i] = { lambda[i], v0[i] * v0[i] };
+    std::sort(nodes.begin(), nodes.end());
+
+    // Symmetrized, so that the rules of different sizes share the centre exactly
+    rule.x.resize(n);
+    rule.w.resize(n);
+    for (int i = 0; i < n; ++i) {
+        const int j = n - 1 - i;
+        rule.x[i] = 0.5 * (nodes[i].first - nodes[j].first);
+        rule.w[i] = 0.5 * (nodes[i].second + nodes[j].second);
+    }
+    if (n % 2 == 1) rule.x[n / 2] = 0.0;
+
+    return rule;
+}
+
+double basis(Family family, int degree, double xi) {
+
+    double prev = 1.0, curr = xi;
+    if (degree == 0) return 1.0;
+
+    for (int k = 1; k < degree; ++k) {
+        const double next = family == Family::uniform
+            ? ((2.0 * k + 1.0) * xi * curr - k * prev) / (k + 1.0)
+            : xi * curr - k * prev;
+        prev = curr;
+        curr = next;
+    }
+
+    if (family == Family::uniform) return curr * std::sqrt(2.0 * degree + 1.0);
+
+    double factorial = 1.0;
+    for (int k = 2; k <= degree; ++k) factorial *= k;
+    return curr / std::sqrt(factorial);
+}
+
+Grid smolyak(const std::vector<Family>& families, int level) {
+
+    const int d = static_cast<int>(families.size());
+    if (d < 1) throw std::runtime_error("UQ: no uncertain parameters");
+    if (level < 1) throw std::runtime_error("UQ: the sparse grid level must be at least 1");
+
+    Grid grid;
+    grid.families = families;
+
+    std::map<std::vector<double>, int> index;
+    std::map<std::pair<int, int>, Rule> rules;      // (dimension, points)
+
+    auto rule = [&](int q, int n) -> const Rule& {
+        auto it = rules.find({ q, n });
+        if (it == rules.end()) it = rules.emplace(std::make_pair(q, n), gauss(families[q], n)).first;
+        return it->second;
+    };
+
+    auto binomial = [](int n, int k) {
+        double b = 1.0;
+        for (int i = 1; i <= k; ++i) b = b * (n - k + i) / i;
+        return b;
+    };
+
+    const int top = level + d - 1;
+    std::vector<int> l(d, 1);
+
+    // All l with l_q >= 1 and |l| <= top, lexicographically
+    while (true) {
+
+        int sum = 0;
+        for (int v : l) sum += v;
+
+        if (sum >= level) {
+
+            Grid::Tensor tensor;
+            const int gap = top - sum;
+            tensor.coefficient = (gap % 2 == 0 ? 1.0 : -1.0) * binomial(d - 1, gap);
+
+            int count = 1;
+            for (int q = 0; q < d; ++q) {
+                tensor.points_per_dim.push_back(2 * l[q] - 1);
+                count *= 2 * l[q] - 1;
+            }
+
+            std::vector<int> k(d, 0);
+            for (int node = 0; node < count; ++node) {
+
+                std::vector<double> x(d);
+                double w = 1.0;
+                for (int q = 0; q < d; ++q) {
+                    const Rule& r = rule(q, tensor.points_per_dim[q]);
+                    x[q] = r.x[k[q]];
+                    w *= r.w[k[q]];
+                }
+
+                auto it = index.find(x);
+                if (it == index.end()) {
+                    it = index.emplace(x, static_cast<int>(grid.points.size())).first;
+                    grid.points.push_back(x);
+                }
+
+                tensor.nodes.push_back(it->second);
+                tensor.weights.push_back(w);
+
+                for (int q = 0; q < d; ++q) {
+                    if (++k[q] < tensor.points_per_dim[q]) break;
+                    k[q] = 0;
+                }
+            }
+
+            grid.tensors.push_back(std::move(tensor));
+        }
+
+        // Next multi-index with |l| <= top
+        int q = d - 1;
+        while (q >= 0) {
+            ++l[q];
+            int s = 0;
+            for (int v : l) s += v;
+            if (s <= top) break;
+            l[q] = 1;
+            --q;
+        }
+        if (q < 0) break;
+    }
+
+    return grid;
+}
+
+double Expansion::mean() const {
+
+    for (const auto& term : coefficients) {
+        bool constant = true;
+        for (int degree : term.first) constant = constant && degree == 0;
+        if (constant) return term.second;
+    }
+    return 0.0;
+}
+
+double Expansion::variance() const {
+
+    double v = 0.0;
+    for (const auto& term : coefficients) {
+        bool constant = true;
+        for (int degree : term.first) constant = constant && degree == 0;
+        if (!constant) v += term.second * term.second;
+    }
+    return v;
+}
+
+std::vector<double> Expansion::first_order(int dims) const {
+
+    std::vector<double> S(dims, 0.0);
+    const double V = variance();
+    if (V <= 0.0) return S;
+
+    for (const auto& term : coefficients) {
+        int active = -1, count = 0;
+        for (int q = 0; q < dims; ++q)
+            if (term.first[q] > 0) { active = q; ++count; }
+        if (count == 1) S[active] += term.second * term.second / V;
+    }
+    return S;
+}
+
+std::vector<double> Expansion::total(int dims) const {
+
+    std::vector<double> S(dims, 0.0);
+    const double V = variance();
+    if (V <= 0.0) return S;
+
+    for (const auto& term : coefficients)
+        for (int q = 0; q < dims; ++q)
+            if (term.first[q] > 0) S[q] += term.second * term.second / V;
+    return S;
+}
+
+Expansion pseudospectral(const Grid& grid, const std::vector<double>& values) {
+
+    const int d = static_cast<int>(grid.families.size());
+    Expansion expansion;
+
+    for (const Grid::Tensor& tensor : grid.tensors) {
+
+        // Degrees alpha_q < points_per_dim[q]
+        std::vector<int> alpha(d, 0);
+
+        while (true) {
+
+            double c = 0.0;
+            for (std::size_t node = 0; node < tensor.nodes.size(); ++node) {
+                const std::vector<double>& x = grid.points[tensor.nodes[node]];
+                double psi = 1.0;
+                for (int q = 0; q < d; ++q) psi *= basis(grid.families[q], alpha[q], x[q]);
+                c += tensor.weights[node] * values[tensor.nodes[node]] * psi;
+            }
+
+            expansion.coefficients[alpha] += tensor.coefficient * c;
+
+            int q = 0;
+            while (q < d) {
+                if (++alpha[q] < tensor.points_per_dim[q]) break;
+                alpha[q] = 0;
+                ++q;
+            }
+            if (q == d) break;
+        }
+    }
+
+    return expansion;
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace uq {
+
+    // Input distributions, each written in terms of a standard variable xi:
+    // uniform on [a, b] as the midpoint plus xi (uniform on [-1, 1]) times the
+    // half width, normal with mean a and standard deviation b as a + b xi
+    // (xi standard normal)
+    enum class Family { uniform, normal };
+
+    struct Distribution {
+        Family family = Family::uniform;
+        double a = 0.0;
+        double b = 0.0;
+
+        double map(double xi) const;
+
+        // "uniform a b" or "normal mean sd"
+        static Distribution parse(const std::string& text);
+    };
+
+    // Gauss rule of n points for the standard variable, weights summing to 1
+    // (Gauss–Legendre or Gauss–Hermite by the Golub–Welsch eigenvalue method).
+    // Nodes are symmetric about 0, exactly 0 in the middle for odd n.
+    struct Rule {
+        std::vector<double> x;
+        std::vector<double> w;
+    };
+
+    Rule gauss(Family family, int n);
+
+    // Orthonormal polynomial of the given degree for the standard variable
+    // (normalized Legendre or probabilists' Hermite)
+    double basis(Family family, int degree, double xi);
+
+    // Smolyak sparse grid as the combination of tensor Gauss rules: level
+    // indices l (l_q >= 1, 2 l_q - 1 points in dimension q) with
+    // level <= |l| <= level + d - 1, weighted by
+    // (-1)^(level + d - 1 - |l|) C(d - 1, level + d - 1 - |l|).
+    // Points shared by several tensors are stored once.
+    struct Grid {
+        struct Tensor {
+            std::vector<int> points_per_dim;
+            double coefficient = 0.0;
+            std::vector<int> nodes;                 // Grid point of every tensor node, first dimension fastest
+            std::vector<double> weights;            // Tensor weight of every node
+        };
+
+        std::vector<Family> families;
+        std::vector<std::vector<double>> points;    // Distinct points in standard variables
+        std::vector<Tensor> tensors;
+    };
+
+    Grid smolyak(const std::vector<Family>& families, int level);
+
+    // Polynomial chaos expansion in the orthonormal basis, keyed by the degree
+    // in every dimension
+    struct Expansion {
+        std::map<std::vector<int>, double> coefficients;
+
+        double mean() const;
+        double variance() const;
+
+        // Sobol indices of every dimension: first order (terms in that
+        // dimension alone) and total (all terms involving it)
+        std::vector<double> first_order(int dims) const;
+        std::vector<double> total(int dims) const;
+    };
+
+    // Smolyak pseudospectral expansion from the values at the grid points:
+    // every tensor rule projects onto the degrees it integrates exactly
+    // (below its point count in each dimension) and the projections are
+    // combined with the Smolyak coefficients, so polynomials of the sparse
+    // span are recovered exactly without the aliasing of a direct sparse
+    // quadrature of the coefficients
+    Expansion pseudospectral(const Grid& grid, const std::vector<double>& values);
+}